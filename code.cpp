@@ -3,9 +3,35 @@
 #include <string>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 #include <limits>
 #include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <iterator>
+#include <string_view>
+#include <charconv>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <queue>
+#include <deque>
+#include <functional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
 // Utility function to safely convert string to int
@@ -46,6 +72,108 @@ double safe_stod(const string &str, double default_value = 0.0)
     }
 }
 
+// Exception-free counterpart of safe_stoi for bulk loading: the same rules as stoi (leading
+// whitespace, an optional sign, digits up to the first non-digit, int range) without a
+// throw for every malformed field. `ok` reports whether a number was found.
+int parseInt(string_view str, int default_value = 0, bool *ok = nullptr)
+{
+    size_t i = 0;
+    while (i < str.size() && isspace((unsigned char)str[i]))
+        i++;
+    if (i < str.size() && str[i] == '+')
+        i++;
+    int value = 0;
+    bool found = false;
+    if (i < str.size() && (isdigit((unsigned char)str[i]) || (str[i] == '-' && (i == 0 || str[i - 1] != '+'))))
+        found = from_chars(str.data() + i, str.data() + str.size(), value).ec == errc();
+    if (ok)
+        *ok = found;
+    return found ? value : default_value;
+}
+
+// Fixed-type object pool. Objects live in large blocks and discarded slots are threaded onto
+// a free list for reuse, so churn never reaches malloc and a bulk load can reserve every
+// slot it needs with a single allocation. Objects keep their address for their lifetime.
+// The owner must destroy() every object it created before the pool goes away.
+template <typename T>
+class ObjectPool
+{
+private:
+    union Slot
+    {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    vector<unique_ptr<Slot[]>> blocks;
+    Slot *freeList;
+    size_t freeCount;
+    size_t liveCount;
+
+    void addBlock(size_t n)
+    {
+        blocks.emplace_back(new Slot[n]);
+        Slot *block = blocks.back().get();
+        // Thread the block so the first slot is handed out first
+        for (size_t i = n; i-- > 0;)
+        {
+            block[i].next = freeList;
+            freeList = &block[i];
+        }
+        freeCount += n;
+    }
+
+public:
+    ObjectPool() : freeList(nullptr), freeCount(0), liveCount(0) {}
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    template <typename... Args>
+    T *create(Args &&...args)
+    {
+        if (!freeList)
+            addBlock(max<size_t>(64, liveCount)); // grow geometrically
+        Slot *slot = freeList;
+        freeList = slot->next; // the object overwrites the link
+        T *obj;
+        try
+        {
+            obj = new (slot->storage) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            slot->next = freeList;
+            freeList = slot;
+            throw;
+        }
+        freeCount--;
+        liveCount++;
+        return obj;
+    }
+
+    void destroy(T *obj)
+    {
+        if (!obj)
+            return;
+        obj->~T();
+        Slot *slot = reinterpret_cast<Slot *>(obj);
+        slot->next = freeList;
+        freeList = slot;
+        freeCount++;
+        liveCount--;
+    }
+
+    // Makes room for `count` more objects with at most one block allocation
+    void reserve(size_t count)
+    {
+        if (count > freeCount)
+            addBlock(count - freeCount);
+    }
+
+    size_t size() const { return liveCount; }
+    size_t blockCount() const { return blocks.size(); }
+};
+
 // Abstract base class Person (Data Abstraction, Virtual Functions)
 class Person
 {
@@ -53,12 +181,12 @@ protected:
     string name;
 
 public:
-    Person(string n) : name(n) {}
+    Person(string n) : name(move(n)) {}
     virtual ~Person() {}
     virtual void display() const = 0;
     virtual void save(ofstream &out) const = 0;
     virtual void load(ifstream &in) = 0;
-    string getName() const { return name; }
+    const string &getName() const { return name; }
     void setName(string n) { name = n; }
 };
 
@@ -67,11 +195,11 @@ class Doctor : public Person
 {
 private:
     vector<string> specialties;
-    int patientCount;
+    atomic<int> patientCount; // adjusted concurrently by admission desks
     double surcharge;
 
 public:
-    Doctor(string n, vector<string> spec, double sur) : Person(n), specialties(spec), patientCount(0), surcharge(sur) {}
+    Doctor(string n, vector<string> spec, double sur) : Person(move(n)), specialties(move(spec)), patientCount(0), surcharge(sur) {}
     Doctor() : Person(""), patientCount(0), surcharge(0) {}
     ~Doctor() {}
 
@@ -129,800 +257,7834 @@ public:
         }
     }
 
-    vector<string> getSpecialties() const { return specialties; }
-    int getPatientCount() const { return patientCount; }
-    void setPatientCount(int c) { patientCount = c; }
+    const vector<string> &getSpecialties() const { return specialties; }
+    int getPatientCount() const { return patientCount.load(memory_order_relaxed); }
+    void setPatientCount(int c) { patientCount.store(c, memory_order_relaxed); }
+    void addPatients(int delta) { patientCount.fetch_add(delta, memory_order_relaxed); }
     double getSurcharge() const { return surcharge; }
+    void setSurcharge(double s) { surcharge = s; }
 };
 
-// Patient class inheriting from Person
-class Patient : public Person
+// One roster entry for HospitalConfig::roster and DoctorRegistry::assign
+struct DoctorSpec
 {
-protected:
-    string disease;
-    string assignedDoctor;
-    string severity;
-    int roomNumber;
+    string name;
+    vector<string> specialties;
+    double surcharge;
+};
 
-public:
-    Patient(string n, string d, string doc, string sev, int room) : Person(n), disease(d), assignedDoctor(doc), severity(sev), roomNumber(room) {}
-    Patient() : Person(""), disease(""), assignedDoctor(""), severity(""), roomNumber(0) {}
-    virtual ~Patient() {}
+// Doctor registry: owns the roster and gives each doctor a stable integer ID. Names are
+// indexed by an open-addressing table of IDs kept at most half full, one allocation for the
+// whole roster rather than a node per doctor.
+class DoctorRegistry
+{
+private:
+    struct NameSlot
+    {
+        uint32_t hash;
+        int id; // -1 for an empty slot
+    };
+
+    ObjectPool<Doctor> pool;
+    vector<Doctor *> doctors;
+    vector<NameSlot> nameSlots; // size is a power of two
+
+    static uint32_t hashOf(string_view name) { return (uint32_t)hash<string_view>()(name); }
 
-    virtual void display() const override
+    // Slot holding `name`, or the empty slot where it would go
+    size_t slotFor(string_view name, uint32_t h) const
     {
-        cout << "Patient: " << name << ", Disease: " << disease << ", Doctor: " << assignedDoctor << ", Severity: " << severity << ", Room: " << roomNumber << "\n";
+        size_t mask = nameSlots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask)
+        {
+            const NameSlot &slot = nameSlots[i];
+            if (slot.id < 0 || (slot.hash == h && doctors[slot.id]->getName() == name))
+                return i;
+        }
     }
 
-    virtual void save(ofstream &out) const override
+    // Empties the name table and sizes it for `count` doctors
+    void sizeNames(size_t count)
     {
-        out << "PATIENT\n";
-        out << name << "\n";
-        out << disease << "\n";
-        out << assignedDoctor << "\n";
-        out << severity << "\n";
-        out << roomNumber << "\n";
+        size_t capacity = 16;
+        while (capacity < 2 * count)
+            capacity *= 2;
+        nameSlots.assign(capacity, {0, -1});
     }
 
-    virtual void load(ifstream &in) override
+    // Sizes the name table for `count` doctors and re-inserts the current ones
+    void resizeNames(size_t count)
     {
-        string marker;
-        getline(in, marker); // Read PATIENT marker
+        sizeNames(count);
+        for (int id = 0; id < (int)doctors.size(); id++)
+        {
+            uint32_t h = hashOf(doctors[id]->getName());
+            nameSlots[slotFor(doctors[id]->getName(), h)] = {h, id};
+        }
+    }
 
-        getline(in, name);
-        getline(in, disease);
-        getline(in, assignedDoctor);
-        getline(in, severity);
+public:
+    DoctorRegistry() {}
+    DoctorRegistry(const DoctorRegistry &) = delete;
+    DoctorRegistry &operator=(const DoctorRegistry &) = delete;
+    ~DoctorRegistry() { clear(); }
 
-        string temp;
-        getline(in, temp);
-        roomNumber = safe_stoi(temp, 0);
+    void clear()
+    {
+        for (auto d : doctors)
+            pool.destroy(d);
+        doctors.clear();
+        nameSlots.clear();
     }
 
-    virtual double calculateBill(const map<string, double> &diseaseCost, const map<string, double> &severityMultiplier, double surcharge) const
+    // Replaces the roster in one pass: pool slots, the ID table and the name table are sized
+    // for every doctor up front and names are indexed once the doctors exist. A name listed
+    // twice keeps its first entry; IDs follow the roster order otherwise.
+    void assign(vector<DoctorSpec> roster)
     {
-        auto diseaseIt = diseaseCost.find(disease);
-        auto severityIt = severityMultiplier.find(severity);
+        clear();
+        pool.reserve(roster.size());
+        doctors.reserve(roster.size());
+        for (auto &d : roster)
+            doctors.push_back(pool.create(move(d.name), move(d.specialties), d.surcharge));
 
-        if (diseaseIt == diseaseCost.end() || severityIt == severityMultiplier.end())
+        sizeNames(doctors.size());
+        size_t out = 0;
+        for (size_t i = 0; i < doctors.size(); i++)
         {
-            return 500.0; // Default cost
+            const string &name = doctors[i]->getName();
+            uint32_t h = hashOf(name);
+            doctors[out] = doctors[i]; // slotFor compares against doctors[0, out)
+            size_t slot = slotFor(name, h);
+            if (nameSlots[slot].id >= 0)
+            {
+                pool.destroy(doctors[i]);
+                continue;
+            }
+            nameSlots[slot] = {h, (int)out++};
         }
-
-        return diseaseIt->second * severityIt->second + surcharge;
+        doctors.resize(out);
     }
 
-    string getDisease() const { return disease; }
-    string getAssignedDoctor() const { return assignedDoctor; }
-    string getSeverity() const { return severity; }
-    int getRoomNumber() const { return roomNumber; }
-    void setRoomNumber(int r) { roomNumber = r; }
-};
-
-// EmergencyPatient inheriting from Patient
-class EmergencyPatient : public Patient
-{
-public:
-    EmergencyPatient(string n, string d, string doc, string sev, int room) : Patient(n, d, doc, sev, room) {}
-    EmergencyPatient() : Patient() {}
-    ~EmergencyPatient() {}
-
-    void display() const override
+    // Returns the existing ID if the name is already registered
+    int add(const string &name, const vector<string> &specialties, double surcharge)
     {
-        cout << "Emergency Patient: " << name << ", Disease: " << disease << ", Doctor: " << assignedDoctor << ", Severity: " << severity << ", Room: " << roomNumber << "\n";
+        if (2 * (doctors.size() + 1) > nameSlots.size())
+            resizeNames(doctors.size() + 1);
+        uint32_t h = hashOf(name);
+        size_t slot = slotFor(name, h);
+        if (nameSlots[slot].id >= 0)
+            return nameSlots[slot].id;
+        int id = (int)doctors.size();
+        doctors.push_back(pool.create(name, specialties, surcharge));
+        nameSlots[slot] = {h, id};
+        return id;
     }
 
-    void save(ofstream &out) const override
+    // Returns -1 if no doctor has this name
+    int findId(string_view name) const
     {
-        out << "EMERGENCY\n";
-        out << name << "\n";
-        out << disease << "\n";
-        out << assignedDoctor << "\n";
-        out << severity << "\n";
-        out << roomNumber << "\n";
+        if (nameSlots.empty())
+            return -1;
+        return nameSlots[slotFor(name, hashOf(name))].id;
     }
 
-    void load(ifstream &in) override
-    {
-        string marker;
-        getline(in, marker); // Read EMERGENCY marker
-
-        getline(in, name);
-        getline(in, disease);
-        getline(in, assignedDoctor);
-        getline(in, severity);
+    bool isValid(int id) const { return id >= 0 && id < (int)doctors.size(); }
+    Doctor *get(int id) const { return isValid(id) ? doctors[id] : nullptr; }
 
-        string temp;
-        getline(in, temp);
-        roomNumber = safe_stoi(temp, 0);
+    const string &nameOf(int id) const
+    {
+        static const string none;
+        return isValid(id) ? doctors[id]->getName() : none;
     }
+    double surchargeOf(int id) const { return isValid(id) ? doctors[id]->getSurcharge() : 0; }
 
-    double calculateBill(const map<string, double> &diseaseCost, const map<string, double> &severityMultiplier, double surcharge) const override
+    void adjustPatientCount(int id, int delta)
     {
-        double base = Patient::calculateBill(diseaseCost, severityMultiplier, surcharge);
-        return base * 1.5;
+        if (isValid(id))
+            doctors[id]->addPatients(delta);
     }
+
+    int size() const { return (int)doctors.size(); }
+    const vector<Doctor *> &all() const { return doctors; }
 };
 
-// Global room management
-const int TOTAL_ROOMS = 100;
-vector<bool> rooms(TOTAL_ROOMS, false);
+// Built-in tariffs, fixed at compile time
+struct TariffEntry
+{
+    string_view name;
+    double value;
+};
 
-int findAvailableRoom()
+constexpr TariffEntry BUILTIN_DISEASE_COSTS[] = {
+    {"Flu", 1000}, {"Cold", 500}, {"Fever", 800}, {"Diabetes", 4000}, {"Hypertension", 3000}, {"Asthma", 2500}, {"Allergy", 1200}, {"Migraine", 1500}, {"Obesity", 3500}, {"Heart Disease", 5000}, {"Skin Infection", 1000}, {"Pneumonia", 4500}, {"Infection", 2000}};
+
+constexpr TariffEntry BUILTIN_SEVERITY_MULTIPLIERS[] = {{"Mild", 1.0}, {"Moderate", 1.5}, {"Severe", 2.0}};
+
+// Cheap seeded hash of a name's length and first, middle and last characters. It only has
+// to separate the built-in names, which PerfectHash checks at compile time; any other name
+// is rejected by the string compare after the slot lookup.
+constexpr uint32_t tariffHash(string_view name, uint32_t seed)
 {
-    for (int i = 0; i < (int)rooms.size(); ++i)
-    {
-        if (!rooms[i])
-            return i;
-    }
-    return -1;
+    size_t n = name.size();
+    uint32_t key = (uint32_t)n;
+    if (n > 0)
+        key |= (uint32_t)(uint8_t)name[0] << 8 | (uint32_t)(uint8_t)name[n / 2] << 16 | (uint32_t)(uint8_t)name[n - 1] << 24;
+    uint32_t h = key * ((seed << 1) + 0x9E3779B1u);
+    return h ^ (h >> 17);
 }
 
-// Hospital class
-class Hospital
+// Collision-free hash from a fixed set of names to their table index. The seed is searched
+// for at compile time, so a lookup is one hash, one slot read and one string compare.
+template <size_t N, size_t SLOTS>
+struct PerfectHash
 {
-private:
-    vector<Doctor *> doctors;
-    vector<Patient *> patients;
-    map<string, double> diseaseCost;
-    map<string, double> severityMultiplier;
-    const string dataFile = "hospital_data.txt";
+    static_assert((SLOTS & (SLOTS - 1)) == 0 && SLOTS >= N, "SLOTS must be a power of two no smaller than N");
 
-    void initializeDoctors()
+    const TariffEntry *entries;
+    uint32_t seed;
+    int16_t slots[SLOTS]; // entry index, or -1 for an empty slot
+
+    constexpr PerfectHash(const TariffEntry (&table)[N]) : entries(table), seed(0), slots{}
     {
-        // Clear existing doctors
-        for (auto d : doctors)
-            delete d;
-        doctors.clear();
+        for (seed = 0; seed < 100000; seed++)
+        {
+            for (auto &s : slots)
+                s = -1;
+            bool collided = false;
+            for (size_t i = 0; i < N && !collided; i++)
+            {
+                int16_t &s = slots[tariffHash(table[i].name, seed) & (SLOTS - 1)];
+                collided = s != -1;
+                s = (int16_t)i;
+            }
+            if (!collided)
+                return;
+        }
+        throw "no collision-free seed"; // fails the build when evaluated at compile time
+    }
 
-        // Initialize with fresh doctors
-        doctors.push_back(new Doctor("Dr. Smith", {"Flu", "Cold"}, 800));
-        doctors.push_back(new Doctor("Dr. Jones", {"Diabetes", "Hypertension"}, 1500));
-        doctors.push_back(new Doctor("Dr. Brown", {"Asthma", "Allergy"}, 1200));
-        doctors.push_back(new Doctor("Dr. Taylor", {"Fever", "Flu"}, 900));
-        doctors.push_back(new Doctor("Dr. Wilson", {"Cold", "Migraine"}, 700));
-        doctors.push_back(new Doctor("Dr. Moore", {"Diabetes", "Obesity"}, 2000));
-        doctors.push_back(new Doctor("Dr. Clark", {"Hypertension", "Heart Disease"}, 2500));
-        doctors.push_back(new Doctor("Dr. Lewis", {"Allergy", "Skin Infection"}, 800));
-        doctors.push_back(new Doctor("Dr. Hall", {"Asthma", "Pneumonia"}, 1800));
-        doctors.push_back(new Doctor("Dr. Allen", {"Fever", "Infection"}, 1000));
+    // Returns -1 for names outside the table
+    constexpr int find(string_view name) const
+    {
+        int i = slots[tariffHash(name, seed) & (SLOTS - 1)];
+        return i >= 0 && entries[i].name == name ? i : -1;
     }
 
+    constexpr size_t size() const { return N; }
+};
+
+constexpr PerfectHash<size(BUILTIN_DISEASE_COSTS), 32> BUILTIN_DISEASE_HASH(BUILTIN_DISEASE_COSTS);
+constexpr PerfectHash<size(BUILTIN_SEVERITY_MULTIPLIERS), 4> BUILTIN_SEVERITY_HASH(BUILTIN_SEVERITY_MULTIPLIERS);
+static_assert(BUILTIN_DISEASE_HASH.find("Heart Disease") == 9 && BUILTIN_DISEASE_HASH.find("Gout") == -1, "disease perfect hash");
+static_assert(BUILTIN_SEVERITY_HASH.find("Severe") == 2 && BUILTIN_SEVERITY_HASH.find("Critical") == -1, "severity perfect hash");
+
+// One kind of tariff (disease costs or severity multipliers) keyed by a small code.
+// Built-in names keep their table index as code and resolve through the perfect hash;
+// names added at runtime get the following codes and a hash-map lookup. A negative value
+// means the name has no tariff.
+template <size_t N, size_t SLOTS>
+class TariffColumn
+{
+private:
+    const PerfectHash<N, SLOTS> *builtin;
+    vector<string> names;
+    vector<double> values;
+    unordered_map<string, int> addedCodes;
+
 public:
-    Hospital()
+    explicit TariffColumn(const PerfectHash<N, SLOTS> &hash) : builtin(&hash)
     {
-        diseaseCost = {
-            {"Flu", 1000}, {"Cold", 500}, {"Fever", 800}, {"Diabetes", 4000}, {"Hypertension", 3000}, {"Asthma", 2500}, {"Allergy", 1200}, {"Migraine", 1500}, {"Obesity", 3500}, {"Heart Disease", 5000}, {"Skin Infection", 1000}, {"Pneumonia", 4500}, {"Infection", 2000}};
-
-        severityMultiplier = {{"Mild", 1.0}, {"Moderate", 1.5}, {"Severe", 2.0}};
+        for (size_t i = 0; i < N; i++)
+        {
+            names.emplace_back(hash.entries[i].name);
+            values.push_back(hash.entries[i].value);
+        }
+    }
 
-        initializeDoctors(); // Always start with fresh doctors
-        loadFromFile();
+    // Returns -1 for unknown names
+    int codeOf(string_view name) const
+    {
+        int code = builtin->find(name);
+        if (code >= 0 || addedCodes.empty())
+            return code;
+        auto it = addedCodes.find(string(name));
+        return it == addedCodes.end() ? -1 : it->second;
     }
 
-    ~Hospital()
+    // Negative if the name has no tariff
+    double valueOf(string_view name) const
     {
-        for (auto d : doctors)
-            delete d;
-        for (auto p : patients)
-            delete p;
+        int code = codeOf(name);
+        return code < 0 ? -1 : values[code];
     }
 
-    void showDiseases()
+    // Overrides a tariff or adds a new name; a negative value withdraws it
+    void set(const string &name, double value)
     {
-        cout << "Available diseases:\n";
-        vector<string> diseaseList;
-        for (auto doc : doctors)
+        int code = codeOf(name);
+        if (code < 0)
         {
-            for (auto &d : doc->getSpecialties())
-            {
-                if (find(diseaseList.begin(), diseaseList.end(), d) == diseaseList.end())
-                {
-                    diseaseList.push_back(d);
-                }
-            }
+            code = (int)names.size();
+            names.push_back(name);
+            values.push_back(value);
+            addedCodes[name] = code;
         }
+        values[code] = value;
+    }
 
-        for (size_t i = 0; i < diseaseList.size(); i++)
+    size_t size() const { return names.size(); }
+    const string &nameOf(int code) const { return names[code]; }
+    double value(int code) const { return values[code]; }
+};
+
+// Disease costs, severity multipliers, the emergency factor and doctor surcharge overrides
+// used for billing and doctor recommendations. Starts as the built-in tariff; load() applies
+// a custom tariff file on top.
+class TariffSchedule
+{
+public:
+    TariffColumn<size(BUILTIN_DISEASE_COSTS), 32> diseaseCost;
+    TariffColumn<size(BUILTIN_SEVERITY_MULTIPLIERS), 4> severityMultiplier;
+    double emergencyFactor = 1.5;
+    unordered_map<string, double> surcharges; // by doctor name; others keep the roster's
+
+    TariffSchedule() : diseaseCost(BUILTIN_DISEASE_HASH), severityMultiplier(BUILTIN_SEVERITY_HASH) {}
+
+    // Reads overrides, one per line: "disease <cost> <name>", "severity <multiplier> <name>",
+    // "surcharge <amount> <doctor name>" or "emergency <factor>". Names run to the end of the
+    // line; a negative disease or severity value withdraws a built-in entry and lines starting
+    // with '#' are comments. On failure `error` names the bad line and nothing is applied.
+    bool load(const string &path, string &error)
+    {
+        ifstream in(path);
+        if (!in)
         {
-            cout << i + 1 << ". " << diseaseList[i] << "\n";
+            error = "cannot open " + path;
+            return false;
         }
-    }
 
-    void showDoctorsForDisease(const string &disease)
-    {
-        cout << "Doctors who can treat " << disease << ":\n";
-        bool found = false;
-        for (auto doc : doctors)
+        struct Override
+        {
+            string kind;
+            string name;
+            double value;
+        };
+        vector<Override> overrides;
+        string line;
+        for (int lineNo = 1; getline(in, line); lineNo++)
         {
-            auto specs = doc->getSpecialties();
-            if (find(specs.begin(), specs.end(), disease) != specs.end())
+            if (line.empty() || line[0] == '#')
+                continue;
+            istringstream fields(line);
+            string kind, value, name;
+            fields >> kind >> value;
+            getline(fields >> ws, name);
+            char *end = nullptr;
+            double number = strtod(value.c_str(), &end);
+            bool valid = !value.empty() && *end == '\0';
+            if (kind == "emergency")
+                valid = valid && name.empty() && number > 0;
+            else if (kind == "surcharge")
+                valid = valid && !name.empty() && number >= 0;
+            else
+                valid = valid && (kind == "disease" || kind == "severity") && !name.empty();
+            if (!valid)
             {
-                cout << "- " << doc->getName() << " (Current Patients: " << doc->getPatientCount() << ", Surcharge: Rs." << doc->getSurcharge() << ")\n";
-                found = true;
+                error = path + ":" + to_string(lineNo) + ": expected \"disease|severity|surcharge <value> <name>\" or \"emergency <factor>\"";
+                return false;
             }
+            overrides.push_back({kind, name, number});
         }
-        if (!found)
+
+        for (auto &o : overrides)
         {
-            cout << "No doctors found for this disease.\n";
+            if (o.kind == "disease")
+                diseaseCost.set(o.name, o.value);
+            else if (o.kind == "severity")
+                severityMultiplier.set(o.name, o.value);
+            else if (o.kind == "surcharge")
+                surcharges[o.name] = o.value;
+            else
+                emergencyFactor = o.value;
         }
+        return true;
     }
+};
+
+// Inverted index from disease to the doctors who treat it, and the severities with a tariff
+class DiseaseIndex
+{
+private:
+    vector<string> diseases; // in order of first appearance in the roster
+    unordered_map<string, int> codeByName;
+    vector<vector<int>> doctorsByDisease;
 
-    double getDoctorSurcharge(const string &doctorName)
+    vector<string> severities; // those with a tariff multiplier, in tariff order
+    unordered_map<string, int> severityCode;
+
+    int internDisease(const string &disease)
     {
-        for (auto d : doctors)
-            if (d->getName() == doctorName)
-                return d->getSurcharge();
-        return 0;
+        auto it = codeByName.find(disease);
+        if (it != codeByName.end())
+            return it->second;
+        int code = (int)diseases.size();
+        diseases.push_back(disease);
+        codeByName[disease] = code;
+        doctorsByDisease.push_back({});
+        return code;
     }
 
-    string recommendLeastCostDoctor(const string &disease, const string &severity)
+public:
+    void clear()
     {
-        double minCost = 1e9;
-        string recommended;
-        for (auto doc : doctors)
-        {
-            auto specs = doc->getSpecialties();
-            if (find(specs.begin(), specs.end(), disease) != specs.end())
-            {
-                if (diseaseCost.find(disease) != diseaseCost.end() &&
-                    severityMultiplier.find(severity) != severityMultiplier.end())
-                {
-                    double cost = diseaseCost.at(disease) * severityMultiplier.at(severity) + doc->getSurcharge();
-                    if (cost < minCost)
-                    {
-                        minCost = cost;
-                        recommended = doc->getName();
-                    }
-                }
-            }
-        }
-        return recommended.empty() ? doctors[0]->getName() : recommended;
+        diseases.clear();
+        codeByName.clear();
+        doctorsByDisease.clear();
     }
 
-    void addPatient()
+    void addDoctor(int doctorId, const Doctor &doc)
     {
-        string name, disease, severity, assignedDoctor;
-        cout << "Enter patient name: ";
-        cin.ignore();
-        getline(cin, name);
-
-        if (name.empty())
+        for (auto &d : doc.getSpecialties())
         {
-            cout << "Invalid name!\n";
-            return;
+            int code = internDisease(d);
+            vector<int> &list = doctorsByDisease[code];
+            if (!list.empty() && list.back() == doctorId)
+                continue; // specialty listed twice
+            list.push_back(doctorId);
         }
+    }
 
-        showDiseases();
-        int choice;
-        cout << "Choose disease number: ";
-        cin >> choice;
-
-        vector<string> diseaseList;
-        for (auto doc : doctors)
+    // Indexes a whole roster in one pass: every specialty is interned into a disease code
+    // once, and each disease's doctor list is sized before it is filled
+    void build(const DoctorRegistry &registry)
+    {
+        clear();
+        vector<int> codes; // every doctor's specialty codes, in roster order
+        vector<int> counts;
+        for (Doctor *doc : registry.all())
         {
             for (auto &d : doc->getSpecialties())
             {
-                if (find(diseaseList.begin(), diseaseList.end(), d) == diseaseList.end())
-                    diseaseList.push_back(d);
+                int code = internDisease(d);
+                codes.push_back(code);
+                if (code >= (int)counts.size())
+                    counts.resize(code + 1, 0);
+                counts[code]++;
             }
         }
+        for (size_t code = 0; code < counts.size(); code++)
+            doctorsByDisease[code].reserve(counts[code]);
 
-        if (choice < 1 || choice > (int)diseaseList.size())
+        size_t next = 0;
+        for (int id = 0; id < registry.size(); id++)
         {
-            cout << "Invalid choice!\n";
-            return;
+            for (size_t i = 0; i < registry.get(id)->getSpecialties().size(); i++)
+            {
+                vector<int> &list = doctorsByDisease[codes[next++]];
+                if (list.empty() || list.back() != id) // specialty listed twice
+                    list.push_back(id);
+            }
         }
-        disease = diseaseList[choice - 1];
-
-        cout << "Enter severity (Mild/Moderate/Severe): ";
-        cin >> severity;
+    }
 
-        if (severity != "Mild" && severity != "Moderate" && severity != "Severe")
+    // Recomputes the severities from the tariffs, e.g. after they change
+    void rebuildSeverities(const TariffSchedule &tariff)
+    {
+        severities.clear();
+        severityCode.clear();
+        for (size_t code = 0; code < tariff.severityMultiplier.size(); code++)
         {
-            cout << "Invalid severity! Using 'Mild' as default.\n";
-            severity = "Mild";
+            double multiplier = tariff.severityMultiplier.value((int)code);
+            if (multiplier < 0)
+                continue;
+            severityCode[tariff.severityMultiplier.nameOf((int)code)] = (int)severities.size();
+            severities.push_back(tariff.severityMultiplier.nameOf((int)code));
         }
+    }
 
-        showDoctorsForDisease(disease);
-        string recommended = recommendLeastCostDoctor(disease, severity);
-        cout << "\nRecommended doctor (least cost): " << recommended << "\n";
-        cout << "Do you want to accept this doctor? (y/n): ";
-        char ans;
-        cin >> ans;
+    // Returns -1 if no doctor treats the disease
+    int codeOf(const string &disease) const
+    {
+        auto it = codeByName.find(disease);
+        return it == codeByName.end() ? -1 : it->second;
+    }
 
-        if (ans == 'y' || ans == 'Y')
-        {
-            assignedDoctor = recommended;
-        }
-        else
-        {
-            cout << "Enter the name of doctor you want: ";
-            cin.ignore();
-            getline(cin, assignedDoctor);
+    // Returns -1 for severities without a tariff multiplier
+    int severityCodeOf(const string &severity) const
+    {
+        auto it = severityCode.find(severity);
+        return it == severityCode.end() ? -1 : it->second;
+    }
 
-            bool doctorExists = false;
-            for (auto doc : doctors)
-            {
-                if (doc->getName() == assignedDoctor)
-                {
-                    doctorExists = true;
-                    break;
-                }
-            }
-            if (!doctorExists)
-            {
-                cout << "Doctor not found! Using recommended doctor.\n";
-                assignedDoctor = recommended;
-            }
-        }
+    const vector<string> &allSeverities() const { return severities; }
 
-        int roomIndex = findAvailableRoom();
-        if (roomIndex == -1)
+    const vector<int> &doctorsFor(int code) const { return doctorsByDisease[code]; }
+    const vector<string> &all() const { return diseases; }
+    int size() const { return (int)diseases.size(); }
+};
+
+// Load-aware doctor recommendation. For every disease an indexed min-heap ranks the doctors
+// who treat it by
+//     score = surcharge + loadWeight * patients
+// with doctors at the cap after everyone else and ties going to the earlier doctor in the
+// roster. The disease and severity part of a bill is the same whichever doctor treats it, so
+// one heap serves every severity, and with loadWeight 0 the choice is the least-cost doctor.
+// A load change re-sifts the doctor in the heap of each of its specialties, O(log doctors)
+// apiece. Thread-safe; with neither a weight nor a cap the ranking never changes and loads
+// are not tracked at all.
+class DoctorRecommender
+{
+public:
+    static const int NONE = -1; // no doctor treats the disease, or it has no tariff
+    static const int FULL = -2; // every doctor who treats it is at the cap
+
+private:
+    struct Entry
+    {
+        int doctorId;
+        int membership; // index into memberships
+    };
+    struct Membership
+    {
+        int disease;
+        size_t slot; // of the doctor in heaps[disease]
+    };
+
+    vector<vector<Entry>> heaps; // by DiseaseIndex code
+    vector<bool> treatable;      // the disease has a tariff
+    vector<Membership> memberships; // every doctor's, grouped by doctor
+    vector<int> firstMembership;    // by doctor ID, plus one past the last doctor
+    vector<double> surcharges;
+    vector<int> loads; // current patients, plus admissions in progress
+    double loadWeight = 0;
+    int cap = 0; // 0 for none
+    mutable mutex lock;
+
+    bool dynamic() const { return loadWeight != 0 || cap > 0; }
+    bool atCap(int doctorId) const { return cap > 0 && loads[doctorId] >= cap; }
+    double score(int doctorId) const { return surcharges[doctorId] + loadWeight * loads[doctorId]; }
+
+    // True if a should be recommended ahead of b
+    bool ahead(const Entry &a, const Entry &b) const
+    {
+        bool fullA = atCap(a.doctorId), fullB = atCap(b.doctorId);
+        if (fullA != fullB)
+            return fullB;
+        double scoreA = score(a.doctorId), scoreB = score(b.doctorId);
+        if (scoreA != scoreB)
+            return scoreA < scoreB;
+        return a.doctorId < b.doctorId;
+    }
+
+    void place(vector<Entry> &heap, size_t slot, const Entry &e)
+    {
+        heap[slot] = e;
+        memberships[e.membership].slot = slot;
+    }
+
+    void siftUp(vector<Entry> &heap, size_t slot)
+    {
+        Entry e = heap[slot];
+        while (slot > 0 && ahead(e, heap[(slot - 1) / 2]))
         {
-            cout << " Sorry, no rooms are currently available. Cannot admit patient.\n";
-            return;
+            place(heap, slot, heap[(slot - 1) / 2]);
+            slot = (slot - 1) / 2;
         }
+        place(heap, slot, e);
+    }
 
-        for (auto doc : doctors)
+    void siftDown(vector<Entry> &heap, size_t slot)
+    {
+        Entry e = heap[slot];
+        while (true)
         {
-            if (doc->getName() == assignedDoctor)
-            {
-                doc->setPatientCount(doc->getPatientCount() + 1);
+            size_t child = 2 * slot + 1;
+            if (child >= heap.size())
                 break;
-            }
+            if (child + 1 < heap.size() && ahead(heap[child + 1], heap[child]))
+                child++;
+            if (!ahead(heap[child], e))
+                break;
+            place(heap, slot, heap[child]);
+            slot = child;
         }
+        place(heap, slot, e);
+    }
 
-        Patient *p = new Patient(name, disease, assignedDoctor, severity, roomIndex + 1);
-        rooms[roomIndex] = true;
-        patients.push_back(p);
-        cout << "Patient added! Assigned Doctor: " << assignedDoctor << ", Room: " << p->getRoomNumber() << "\n";
+    // Restores every heap the doctor is in after its load changed by delta; a higher load
+    // only ever ranks a doctor lower. Caller holds lock.
+    void resift(int doctorId, int delta)
+    {
+        for (int i = firstMembership[doctorId]; i < firstMembership[doctorId + 1]; i++)
+        {
+            if (delta > 0)
+                siftDown(heaps[memberships[i].disease], memberships[i].slot);
+            else
+                siftUp(heaps[memberships[i].disease], memberships[i].slot);
+        }
     }
 
-    void addEmergencyPatient()
+    int top(int disease) const
     {
-        string name, disease, severity, assignedDoctor;
-        cout << "Enter emergency patient name: ";
-        cin.ignore();
-        getline(cin, name);
+        if (disease < 0 || disease >= (int)heaps.size() || !treatable[disease] || heaps[disease].empty())
+            return NONE;
+        int doctorId = heaps[disease][0].doctorId;
+        return atCap(doctorId) ? FULL : doctorId;
+    }
 
-        if (name.empty())
+public:
+    // Sets the policy; takes effect at the next rebuild
+    void configure(double weight, int maxPatients)
+    {
+        loadWeight = weight;
+        cap = max(0, maxPatients);
+    }
+
+    double weight() const { return loadWeight; }
+    int maxPatients() const { return cap; }
+
+    // Builds the heaps from the roster, its current patient counts and the tariffs
+    void rebuild(const DiseaseIndex &index, const DoctorRegistry &registry, const TariffSchedule &tariff)
+    {
+        lock_guard<mutex> guard(lock);
+        heaps.assign(index.size(), {});
+        treatable.assign(index.size(), false);
+        surcharges.assign(registry.size(), 0);
+        loads.assign(registry.size(), 0);
+        for (int id = 0; id < registry.size(); id++)
         {
-            cout << "Invalid name!\n";
-            return;
+            surcharges[id] = registry.surchargeOf(id);
+            loads[id] = registry.get(id)->getPatientCount();
         }
 
-        showDiseases();
-        int choice;
-        cout << "Choose disease number: ";
-        cin >> choice;
+        // Memberships are laid out doctor by doctor, counted before they are placed
+        firstMembership.assign(registry.size() + 1, 0);
+        for (int code = 0; code < index.size(); code++)
+            for (int id : index.doctorsFor(code))
+                firstMembership[id + 1]++;
+        for (int id = 0; id < registry.size(); id++)
+            firstMembership[id + 1] += firstMembership[id];
+        memberships.assign(firstMembership.back(), {});
+        vector<int> nextMembership(firstMembership.begin(), firstMembership.end() - 1);
 
-        vector<string> diseaseList;
-        for (auto doc : doctors)
+        for (int code = 0; code < index.size(); code++)
         {
-            for (auto &d : doc->getSpecialties())
+            treatable[code] = tariff.diseaseCost.valueOf(index.all()[code]) >= 0;
+            vector<Entry> &heap = heaps[code];
+            heap.reserve(index.doctorsFor(code).size());
+            for (int id : index.doctorsFor(code))
             {
-                if (find(diseaseList.begin(), diseaseList.end(), d) == diseaseList.end())
-                    diseaseList.push_back(d);
+                int m = nextMembership[id]++;
+                memberships[m] = {code, heap.size()};
+                heap.push_back({id, m});
             }
+            // Bottom-up heap construction: O(doctors) rather than one sift per insert
+            for (size_t slot = heap.size() / 2; slot-- > 0;)
+                siftDown(heap, slot);
         }
+    }
+
+    // Best doctor for the disease without claiming it: a doctor ID, NONE or FULL
+    int recommend(int disease) const
+    {
+        if (!dynamic())
+            return top(disease);
+        lock_guard<mutex> guard(lock);
+        return top(disease);
+    }
 
-        if (choice < 1 || choice > (int)diseaseList.size())
+    // Like recommend(), but counts the admission against the doctor straight away so that
+    // concurrent admissions cannot overshoot the cap. The claim is dropped with release()
+    // once the admission has been accounted for, or has failed.
+    int claim(int disease)
+    {
+        if (!dynamic())
+            return top(disease);
+        lock_guard<mutex> guard(lock);
+        int doctorId = top(disease);
+        if (doctorId >= 0)
         {
-            cout << "Invalid choice!\n";
+            loads[doctorId]++;
+            resift(doctorId, +1);
+        }
+        return doctorId;
+    }
+
+    void release(int doctorId) { adjust(doctorId, -1); }
+
+    // Follows a doctor's patient count
+    void adjust(int doctorId, int delta)
+    {
+        if (!dynamic())
+            return;
+        lock_guard<mutex> guard(lock);
+        if (doctorId < 0 || doctorId >= (int)loads.size())
+            return;
+        loads[doctorId] += delta;
+        resift(doctorId, delta);
+    }
+};
+
+// Stable patient identifier assigned at admission; 0 means none
+typedef uint32_t PatientId;
+
+// Interns short strings such as disease and severity names as small integer codes.
+// Codes are handed out in first-seen order and never change. Each name is stored once and
+// the lookup map keys are views of those copies, so interning a name that is already known
+// (the common case when loading a census) allocates nothing.
+class CodeTable
+{
+private:
+    deque<string> names; // deque so the views in `codes` survive growth
+    unordered_map<string_view, uint16_t> codes;
+
+public:
+    static const uint16_t OVERFLOW_CODE = 0xFFFF; // shared by every name past the last code
+
+    CodeTable() = default;
+    CodeTable(const CodeTable &) = delete; // `codes` points into `names`
+    CodeTable &operator=(const CodeTable &) = delete;
+
+    uint16_t intern(string_view name)
+    {
+        auto it = codes.find(name);
+        if (it != codes.end())
+            return it->second;
+        if (names.size() >= OVERFLOW_CODE)
+            return OVERFLOW_CODE;
+        uint16_t code = (uint16_t)names.size();
+        names.emplace_back(name);
+        codes.emplace(names.back(), code);
+        return code;
+    }
+
+    // Returns -1 for a name that was never interned
+    int find(string_view name) const
+    {
+        auto it = codes.find(name);
+        return it == codes.end() ? -1 : it->second;
+    }
+
+    const string &nameOf(uint16_t code) const
+    {
+        static const string unknown = "Unknown";
+        return code < names.size() ? names[code] : unknown;
+    }
+
+    size_t size() const { return names.size(); }
+};
+
+// Bill inputs resolved per code once, so billing a patient is two array reads instead of
+// two string-keyed map lookups. Indexed by PatientStore disease and severity codes; a
+// negative entry means the name has no tariff and the default cost applies.
+struct TariffTable
+{
+    vector<double> diseaseCost;
+    vector<double> severityMultiplier;
+
+    double emergencyFactor = 1.5;
+
+    static constexpr double DEFAULT_COST = 500.0;
+
+    double bill(uint16_t disease, uint16_t severity, double surcharge, bool emergency) const
+    {
+        double base = DEFAULT_COST;
+        if (disease < diseaseCost.size() && severity < severityMultiplier.size() &&
+            diseaseCost[disease] >= 0 && severityMultiplier[severity] >= 0)
+            base = diseaseCost[disease] * severityMultiplier[severity] + surcharge;
+        return emergency ? base * emergencyFactor : base;
+    }
+};
+
+// Maps patient IDs to store rows: an open-addressing table of (ID, row) slots with linear
+// probing, where ID 0 marks an empty slot. At 8 bytes a slot and at most 3/4 full it costs
+// 11 to 21 bytes per patient, against about 40 for a node-based map, and a lookup touches
+// one or two adjacent slots. Erasing shifts the rest of the probe run back instead of
+// leaving tombstones, so heavy discharge traffic does not slow lookups down.
+class PatientRowIndex
+{
+private:
+    struct Slot
+    {
+        PatientId id;
+        uint32_t row;
+    };
+    vector<Slot> slots; // empty, or a power of 2 in size
+    size_t count = 0;
+    int shift = 32;
+
+    // Fibonacci hashing; IDs within a shard step by PATIENT_SHARDS, which this spreads out
+    size_t home(PatientId id) const { return (uint32_t)(id * 2654435769u) >> shift; }
+
+    // Slot holding `id`, or the empty slot where it would go
+    size_t probe(PatientId id) const
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = home(id);
+        while (slots[i].id && slots[i].id != id)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void rehash(size_t capacity)
+    {
+        int bits = 4;
+        while (((size_t)1 << bits) < capacity)
+            bits++;
+        vector<Slot> old((size_t)1 << bits, Slot{0, 0});
+        old.swap(slots);
+        shift = 32 - bits;
+        for (const Slot &slot : old)
+        {
+            if (slot.id)
+                slots[probe(slot.id)] = slot;
+        }
+    }
+
+public:
+    static const uint32_t NO_ROW = 0xFFFFFFFF;
+
+    uint32_t find(PatientId id) const
+    {
+        if (slots.empty())
+            return NO_ROW;
+        const Slot &slot = slots[probe(id)];
+        return slot.id ? slot.row : NO_ROW;
+    }
+
+    bool contains(PatientId id) const { return find(id) != NO_ROW; }
+
+    // Adds `id`, which must not be 0, or moves it to another row
+    void set(PatientId id, uint32_t row)
+    {
+        if ((count + 1) * 4 > slots.size() * 3)
+            rehash(slots.size() * 2);
+        Slot &slot = slots[probe(id)];
+        if (!slot.id)
+        {
+            slot.id = id;
+            count++;
+        }
+        slot.row = row;
+    }
+
+    bool erase(PatientId id)
+    {
+        if (slots.empty())
+            return false;
+        size_t mask = slots.size() - 1;
+        size_t hole = probe(id);
+        if (!slots[hole].id)
+            return false;
+        // Pull back every later entry of the run that may sit in the hole without being
+        // moved before its home slot
+        for (size_t next = (hole + 1) & mask; slots[next].id; next = (next + 1) & mask)
+        {
+            if (((next - home(slots[next].id)) & mask) >= ((next - hole) & mask))
+            {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+        }
+        slots[hole] = Slot{0, 0};
+        count--;
+        return true;
+    }
+
+    void reserve(size_t entries)
+    {
+        if (entries * 4 > slots.size() * 3)
+            rehash(entries * 4 / 3 + 1);
+    }
+
+    // Empties the table but keeps its slots for reuse
+    void clear()
+    {
+        fill(slots.begin(), slots.end(), Slot{0, 0});
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t memoryBytes() const { return slots.capacity() * sizeof(Slot); }
+};
+
+class Patient;
+
+// Columnar patient store. Each field lives in its own array indexed by row: disease and
+// severity as CodeTable codes, doctor and room as ints, and names packed back to back in
+// one character arena. Bulk passes (billing, reports, filters) walk contiguous columns
+// without virtual calls or string hashing. The store also keeps each patient's bill, which
+// its owner works out and updates when the tariffs change.
+//
+// Patient IDs are handed out at admission, never reused, and persisted with the snapshot.
+// Rows stay in admission order; a discharge only marks its row as a hole (ID 0), and the
+// holes are squeezed out once they outnumber the live patients, so discharges cost
+// amortised O(1). Row numbers, and any Patient views holding them, are therefore only
+// valid until the next add or remove.
+class PatientStore
+{
+private:
+    const DoctorRegistry *registry;
+    shared_ptr<CodeTable> diseaseCodes; // may be shared with other stores, see shareCodes()
+    shared_ptr<CodeTable> severityCodes;
+
+    vector<PatientId> ids; // 0 marks a discharged row
+    vector<uint32_t> nameStart;
+    vector<uint32_t> nameLength;
+    vector<uint16_t> diseases;
+    vector<uint16_t> severities;
+    vector<int32_t> doctorIds; // ID in the DoctorRegistry, -1 if unassigned
+    vector<int32_t> roomNumbers;
+    vector<uint8_t> flags;
+    vector<double> bills; // cached bill, set by the owner; 0 for holes
+    string nameArena;
+
+    PatientRowIndex rowOf;
+    size_t live;
+    PatientId nextId;
+
+    void compact()
+    {
+        string arena;
+        arena.reserve(nameArena.size() / 2);
+        size_t out = 0;
+        for (size_t row = 0; row < ids.size(); row++)
+        {
+            if (!ids[row])
+                continue;
+            ids[out] = ids[row];
+            nameStart[out] = (uint32_t)arena.size();
+            arena.append(nameArena, nameStart[row], nameLength[row]);
+            nameLength[out] = nameLength[row];
+            diseases[out] = diseases[row];
+            severities[out] = severities[row];
+            doctorIds[out] = doctorIds[row];
+            roomNumbers[out] = roomNumbers[row];
+            flags[out] = flags[row];
+            bills[out] = bills[row];
+            rowOf.set(ids[out], (uint32_t)out);
+            out++;
+        }
+        resizeColumns(out);
+        nameArena.swap(arena);
+    }
+
+    void resizeColumns(size_t n)
+    {
+        ids.resize(n);
+        nameStart.resize(n);
+        nameLength.resize(n);
+        diseases.resize(n);
+        severities.resize(n);
+        doctorIds.resize(n);
+        roomNumbers.resize(n);
+        flags.resize(n);
+        bills.resize(n);
+    }
+
+public:
+    static const uint8_t EMERGENCY = 1; // flags bit
+    static const uint32_t NO_ROW = PatientRowIndex::NO_ROW;
+
+    class iterator;
+
+    explicit PatientStore(const DoctorRegistry *reg)
+        : registry(reg), diseaseCodes(make_shared<CodeTable>()), severityCodes(make_shared<CodeTable>()), live(0), nextId(1) {}
+
+    iterator begin() const;
+    iterator end() const;
+
+    // Stores a patient under `id`, or under a fresh ID if `id` is 0 or already taken
+    PatientId add(PatientId id, bool emergency, string_view name, string_view disease, string_view severity, int doctorId, int roomNumber)
+    {
+        if (id == 0 || rowOf.contains(id))
+            id = nextId;
+        nextId = max(nextId, id + 1);
+        rowOf.set(id, (uint32_t)ids.size());
+
+        ids.push_back(id);
+        nameStart.push_back((uint32_t)nameArena.size());
+        nameLength.push_back((uint32_t)name.size());
+        nameArena.append(name.data(), name.size());
+        diseases.push_back(diseaseCodes->intern(disease));
+        severities.push_back(severityCodes->intern(severity));
+        doctorIds.push_back(doctorId);
+        roomNumbers.push_back(roomNumber);
+        flags.push_back(emergency ? EMERGENCY : 0);
+        bills.push_back(0);
+        live++;
+        return id;
+    }
+
+    bool remove(PatientId id)
+    {
+        uint32_t row = rowOf.find(id);
+        if (row == NO_ROW)
+            return false;
+        ids[row] = 0;
+        bills[row] = 0;
+        rowOf.erase(id);
+        live--;
+        if (ids.size() - live > max<size_t>(live, 32))
+            compact();
+        return true;
+    }
+
+    uint32_t rowFor(PatientId id) const { return rowOf.find(id); }
+
+    Patient find(PatientId id) const;
+
+    void reserve(size_t patients, size_t nameBytes = 0)
+    {
+        ids.reserve(patients);
+        nameStart.reserve(patients);
+        nameLength.reserve(patients);
+        diseases.reserve(patients);
+        severities.reserve(patients);
+        doctorIds.reserve(patients);
+        roomNumbers.reserve(patients);
+        flags.reserve(patients);
+        bills.reserve(patients);
+        nameArena.reserve(nameBytes);
+        rowOf.reserve(patients);
+    }
+
+    // Forgets every patient and restarts numbering at `firstId`; codes stay as they are
+    void clear(PatientId firstId = 1)
+    {
+        resizeColumns(0);
+        nameArena.clear();
+        rowOf.clear();
+        live = 0;
+        nextId = firstId;
+    }
+
+    // Pre-assigns codes so they line up with another index, e.g. DiseaseIndex codes
+    void seedCodes(const vector<string> &diseaseNames, const vector<string> &severityNames)
+    {
+        for (auto &d : diseaseNames)
+            diseaseCodes->intern(d);
+        for (auto &s : severityNames)
+            severityCodes->intern(s);
+    }
+
+    // Makes this store intern names into `other`'s code tables, so codes agree between the
+    // two. Interning a new name is not thread-safe, so stores that share tables must only
+    // see new names while no other thread is adding to any of them.
+    void shareCodes(const PatientStore &other)
+    {
+        diseaseCodes = other.diseaseCodes;
+        severityCodes = other.severityCodes;
+    }
+
+    size_t size() const { return live; }
+    bool empty() const { return live == 0; }
+    PatientId peekNextId() const { return nextId; }
+    void reserveIdsBelow(PatientId id) { nextId = max(nextId, id); }
+
+    // Row access; rows include holes, which have id 0
+    size_t rows() const { return ids.size(); }
+    PatientId id(uint32_t row) const { return ids[row]; }
+    string name(uint32_t row) const { return nameArena.substr(nameStart[row], nameLength[row]); }
+    uint16_t diseaseCode(uint32_t row) const { return diseases[row]; }
+    uint16_t severityCode(uint32_t row) const { return severities[row]; }
+    const string &disease(uint32_t row) const { return diseaseCodes->nameOf(diseases[row]); }
+    const string &severity(uint32_t row) const { return severityCodes->nameOf(severities[row]); }
+    int doctorId(uint32_t row) const { return doctorIds[row]; }
+    const string &doctorName(uint32_t row) const
+    {
+        static const string none;
+        return registry ? registry->nameOf(doctorIds[row]) : none;
+    }
+    int roomNumber(uint32_t row) const { return roomNumbers[row]; }
+    bool isEmergency(uint32_t row) const { return flags[row] & EMERGENCY; }
+    double bill(uint32_t row) const { return bills[row]; }
+    void setBill(uint32_t row, double bill) { bills[row] = bill; }
+
+    // Whole columns for bulk passes; skip rows whose id is 0
+    const vector<PatientId> &idColumn() const { return ids; }
+    const vector<uint16_t> &diseaseColumn() const { return diseases; }
+    const vector<uint16_t> &severityColumn() const { return severities; }
+    const vector<int32_t> &doctorColumn() const { return doctorIds; }
+    const vector<uint8_t> &flagColumn() const { return flags; }
+    const vector<double> &billColumn() const { return bills; }
+    const CodeTable &diseaseTable() const { return *diseaseCodes; }
+    const CodeTable &severityTable() const { return *severityCodes; }
+
+    // Approximate heap footprint of the columns, arena and ID index
+    size_t memoryBytes() const
+    {
+        size_t perRow = sizeof(PatientId) + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t) + 2 * sizeof(int32_t) + sizeof(uint8_t) + sizeof(double);
+        return ids.capacity() * perRow + nameArena.capacity() + rowOf.memoryBytes();
+    }
+};
+
+// Lightweight read-only view of one patient in a PatientStore. Views are cheap to copy
+// and are invalidated by the next add or remove on the store. A default-constructed view
+// refers to no patient and tests false.
+class Patient
+{
+protected:
+    const PatientStore *store;
+    uint32_t row;
+
+public:
+    Patient() : store(nullptr), row(PatientStore::NO_ROW) {}
+    Patient(const PatientStore *s, uint32_t r) : store(s), row(r) {}
+
+    explicit operator bool() const { return store && row != PatientStore::NO_ROW; }
+
+    void display() const
+    {
+        cout << (isEmergency() ? "Emergency Patient: " : "Patient: ") << getName() << ", Disease: " << getDisease()
+             << ", Doctor: " << getAssignedDoctor() << ", Severity: " << getSeverity() << ", Room: " << getRoomNumber() << "\n";
+    }
+
+    void save(ofstream &out) const
+    {
+        out << (isEmergency() ? "EMERGENCY" : "PATIENT") << " " << getId() << "\n";
+        out << getName() << "\n";
+        out << getDisease() << "\n";
+        out << getAssignedDoctor() << "\n";
+        out << getSeverity() << "\n";
+        out << getRoomNumber() << "\n";
+    }
+
+    double calculateBill(const TariffTable &tariffs, double surcharge) const
+    {
+        return tariffs.bill(store->diseaseCode(row), store->severityCode(row), surcharge, isEmergency());
+    }
+
+    bool isEmergency() const { return store->isEmergency(row); }
+    double getCachedBill() const { return store->bill(row); }
+    PatientId getId() const { return store->id(row); }
+    string getName() const { return store->name(row); }
+    const string &getDisease() const { return store->disease(row); }
+    uint16_t getDiseaseCode() const { return store->diseaseCode(row); }
+    int getDoctorId() const { return store->doctorId(row); }
+    const string &getAssignedDoctor() const { return store->doctorName(row); }
+    const string &getSeverity() const { return store->severity(row); }
+    uint16_t getSeverityCode() const { return store->severityCode(row); }
+    int getRoomNumber() const { return store->roomNumber(row); }
+};
+
+// View of a patient known to be an emergency admission, as yielded by EmergencyIndex
+class EmergencyPatient : public Patient
+{
+public:
+    EmergencyPatient() {}
+    EmergencyPatient(const PatientStore *s, uint32_t r) : Patient(s, r) {}
+};
+
+// Iterates the live rows of a PatientStore in admission order, skipping holes
+class PatientStore::iterator
+{
+private:
+    const PatientStore *store;
+    uint32_t row;
+
+    void skipHoles()
+    {
+        while (row < store->ids.size() && !store->ids[row])
+            ++row;
+    }
+
+public:
+    iterator(const PatientStore *s, uint32_t r) : store(s), row(r) { skipHoles(); }
+    Patient operator*() const { return Patient(store, row); }
+    iterator &operator++()
+    {
+        ++row;
+        skipHoles();
+        return *this;
+    }
+    bool operator!=(const iterator &other) const { return row != other.row; }
+};
+
+inline PatientStore::iterator PatientStore::begin() const { return iterator(this, 0); }
+inline PatientStore::iterator PatientStore::end() const { return iterator(this, (uint32_t)ids.size()); }
+
+inline Patient PatientStore::find(PatientId id) const
+{
+    uint32_t row = rowFor(id);
+    return row == NO_ROW ? Patient() : Patient(this, row);
+}
+
+// The emergency subset of a PatientStore, kept in admission order so listing emergency
+// patients does not scan the whole census. Holds IDs rather than rows, which survive
+// compaction of the store; holes are squeezed out the same way.
+class EmergencyIndex
+{
+private:
+    const PatientStore *store;
+    vector<PatientId> order; // 0 marks a discharged patient
+    PatientRowIndex slotOf;  // position of each live ID in `order`
+    size_t live;
+
+    void compact()
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            if (!order[i])
+                continue;
+            order[out] = order[i];
+            slotOf.set(order[out], (uint32_t)out);
+            out++;
+        }
+        order.resize(out);
+    }
+
+public:
+    class iterator
+    {
+    private:
+        const EmergencyIndex *index;
+        size_t pos;
+
+        void skipHoles()
+        {
+            while (pos < index->order.size() && !index->order[pos])
+                ++pos;
+        }
+
+    public:
+        iterator(const EmergencyIndex *i, size_t p) : index(i), pos(p) { skipHoles(); }
+        EmergencyPatient operator*() const { return EmergencyPatient(index->store, index->store->rowFor(index->order[pos])); }
+        iterator &operator++()
+        {
+            ++pos;
+            skipHoles();
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return pos != other.pos; }
+    };
+
+    explicit EmergencyIndex(const PatientStore *s) : store(s), live(0) {}
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, order.size()); }
+
+    void insert(PatientId id)
+    {
+        slotOf.set(id, (uint32_t)order.size());
+        order.push_back(id);
+        live++;
+    }
+
+    void remove(PatientId id)
+    {
+        uint32_t slot = slotOf.find(id);
+        if (slot == PatientRowIndex::NO_ROW)
+            return;
+        order[slot] = 0;
+        slotOf.erase(id);
+        live--;
+        if (order.size() - live > max<size_t>(live, 32))
+            compact();
+    }
+
+    EmergencyPatient find(PatientId id) const
+    {
+        if (!slotOf.contains(id))
+            return EmergencyPatient();
+        return EmergencyPatient(store, store->rowFor(id));
+    }
+
+    void clear()
+    {
+        order.clear();
+        slotOf.clear();
+        live = 0;
+    }
+
+    size_t size() const { return live; }
+    bool empty() const { return live == 0; }
+};
+
+// IDs of the patients sharing one attribute value, in ascending order. A discharged ID stays
+// behind as a tombstone until tombstones outnumber live IDs, so removal is a binary search
+// and a scan can resume after any ID.
+class PostingList
+{
+private:
+    vector<PatientId> ids;
+    vector<bool> removed;
+    size_t live = 0;
+
+    void compact()
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < ids.size(); i++)
+            if (!removed[i])
+                ids[out++] = ids[i];
+        ids.resize(out);
+        removed.assign(out, false);
+    }
+
+public:
+    void insert(PatientId id)
+    {
+        live++;
+        if (ids.empty() || id > ids.back())
+        {
+            ids.push_back(id);
+            removed.push_back(false);
+            return;
+        }
+        // Out of order, e.g. a load with saved IDs; a tombstone with the same ID is revived
+        size_t pos = lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+        if (pos < ids.size() && ids[pos] == id)
+        {
+            removed[pos] = false;
+            return;
+        }
+        ids.insert(ids.begin() + pos, id);
+        removed.insert(removed.begin() + pos, false);
+    }
+
+    void remove(PatientId id)
+    {
+        size_t pos = lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+        if (pos == ids.size() || ids[pos] != id || removed[pos])
             return;
+        removed[pos] = true;
+        live--;
+        if (ids.size() - live > max<size_t>(live, 32))
+            compact();
+    }
+
+    // Calls visit(id) for each live ID above `after`, in ascending order, until it returns false
+    template <typename Visit>
+    void scan(PatientId after, Visit visit) const
+    {
+        for (size_t pos = upper_bound(ids.begin(), ids.end(), after) - ids.begin(); pos < ids.size(); pos++)
+            if (!removed[pos] && !visit(ids[pos]))
+                return;
+    }
+
+    void clear()
+    {
+        ids.clear();
+        removed.clear();
+        live = 0;
+    }
+
+    size_t size() const { return live; }
+};
+
+// Patients by name for prefix search. Nodes and patient entries live in pools with free
+// lists, and a node is returned to its pool as soon as no name runs through it, so adding or
+// removing a name costs O(length * siblings) and the trie never outgrows the live names.
+class NameTrie
+{
+private:
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Node
+    {
+        uint32_t firstChild;
+        uint32_t nextSibling; // also links free nodes
+        uint32_t count;       // names ending at or below this node
+        uint32_t patients;    // entries of the names ending here
+        char c;
+    };
+    struct Entry
+    {
+        PatientId id;
+        uint32_t next; // also links free entries
+    };
+
+    vector<Node> nodes; // node 0 is the root
+    vector<Entry> entries;
+    uint32_t freeNodes = NONE;
+    uint32_t freeEntries = NONE;
+
+    uint32_t child(uint32_t node, char c) const
+    {
+        uint32_t n = nodes[node].firstChild;
+        while (n != NONE && nodes[n].c != c)
+            n = nodes[n].nextSibling;
+        return n;
+    }
+
+    uint32_t newNode(uint32_t parent, char c)
+    {
+        uint32_t n = freeNodes;
+        if (n != NONE)
+            freeNodes = nodes[n].nextSibling;
+        else
+        {
+            n = (uint32_t)nodes.size();
+            nodes.push_back({});
+        }
+        nodes[n] = {NONE, nodes[parent].firstChild, 0, NONE, c};
+        nodes[parent].firstChild = n;
+        return n;
+    }
+
+    void unlink(uint32_t parent, uint32_t node)
+    {
+        uint32_t *link = &nodes[parent].firstChild;
+        while (*link != node)
+            link = &nodes[*link].nextSibling;
+        *link = nodes[node].nextSibling;
+        nodes[node].nextSibling = freeNodes;
+        freeNodes = node;
+    }
+
+    template <typename Visit>
+    void visitBelow(uint32_t node, Visit &visit) const
+    {
+        for (uint32_t e = nodes[node].patients; e != NONE; e = entries[e].next)
+            visit(entries[e].id);
+        for (uint32_t n = nodes[node].firstChild; n != NONE; n = nodes[n].nextSibling)
+            visitBelow(n, visit);
+    }
+
+public:
+    NameTrie() { clear(); }
+
+    void insert(const string &name, PatientId id)
+    {
+        uint32_t node = 0;
+        nodes[0].count++;
+        for (char c : name)
+        {
+            uint32_t next = child(node, c);
+            node = next == NONE ? newNode(node, c) : next;
+            nodes[node].count++;
         }
-        disease = diseaseList[choice - 1];
+        uint32_t e = freeEntries;
+        if (e != NONE)
+            freeEntries = entries[e].next;
+        else
+        {
+            e = (uint32_t)entries.size();
+            entries.push_back({});
+        }
+        entries[e] = {id, nodes[node].patients};
+        nodes[node].patients = e;
+    }
+
+    void remove(const string &name, PatientId id)
+    {
+        vector<uint32_t> path(1, 0);
+        for (char c : name)
+        {
+            uint32_t next = child(path.back(), c);
+            if (next == NONE)
+                return;
+            path.push_back(next);
+        }
+        uint32_t *link = &nodes[path.back()].patients;
+        while (*link != NONE && entries[*link].id != id)
+            link = &entries[*link].next;
+        if (*link == NONE)
+            return;
+        uint32_t e = *link;
+        *link = entries[e].next;
+        entries[e].next = freeEntries;
+        freeEntries = e;
+
+        for (size_t i = path.size(); i-- > 0;)
+        {
+            if (--nodes[path[i]].count == 0 && i > 0)
+                unlink(path[i - 1], path[i]);
+        }
+    }
+
+    // Number of names starting with `prefix`
+    size_t countPrefix(const string &prefix) const
+    {
+        uint32_t node = 0;
+        for (size_t i = 0; i < prefix.size() && node != NONE; i++)
+            node = child(node, prefix[i]);
+        return node == NONE ? 0 : nodes[node].count;
+    }
+
+    // Calls visit(id) for every patient whose name starts with `prefix`, in no particular order
+    template <typename Visit>
+    void visitPrefix(const string &prefix, Visit visit) const
+    {
+        uint32_t node = 0;
+        for (size_t i = 0; i < prefix.size() && node != NONE; i++)
+            node = child(node, prefix[i]);
+        if (node != NONE)
+            visitBelow(node, visit);
+    }
+
+    void clear()
+    {
+        nodes.assign(1, {NONE, NONE, 0, NONE, 0});
+        entries.clear();
+        freeNodes = freeEntries = NONE;
+    }
+};
+
+// Secondary indexes over one census shard, kept in step with its PatientStore under the
+// shard lock: posting lists by doctor, disease, severity and emergency flag, one of every
+// patient, and a name trie. The trie is built from the store on the first name query, so
+// loads and shards nobody searches by name do not pay for it.
+class PatientIndex
+{
+private:
+    PostingList everyone;
+    PostingList emergencyList;
+    vector<PostingList> byDoctor; // by doctor ID + 1; slot 0 is "unassigned"
+    vector<PostingList> byDisease; // by PatientStore code
+    vector<PostingList> bySeverity;
+    mutable NameTrie names;
+    mutable bool namesBuilt = false;
+
+    static PostingList &slot(vector<PostingList> &lists, size_t i)
+    {
+        if (i >= lists.size())
+            lists.resize(i + 1);
+        return lists[i];
+    }
+
+    static const PostingList *find(const vector<PostingList> &lists, size_t i) { return i < lists.size() ? &lists[i] : nullptr; }
+
+public:
+    void add(const Patient &p)
+    {
+        PatientId id = p.getId();
+        everyone.insert(id);
+        if (p.isEmergency())
+            emergencyList.insert(id);
+        slot(byDoctor, p.getDoctorId() + 1).insert(id);
+        slot(byDisease, p.getDiseaseCode()).insert(id);
+        slot(bySeverity, p.getSeverityCode()).insert(id);
+        if (namesBuilt)
+            names.insert(p.getName(), id);
+    }
+
+    void remove(const Patient &p)
+    {
+        PatientId id = p.getId();
+        everyone.remove(id);
+        if (p.isEmergency())
+            emergencyList.remove(id);
+        slot(byDoctor, p.getDoctorId() + 1).remove(id);
+        slot(byDisease, p.getDiseaseCode()).remove(id);
+        slot(bySeverity, p.getSeverityCode()).remove(id);
+        if (namesBuilt)
+            names.remove(p.getName(), id);
+    }
+
+    void clear()
+    {
+        everyone.clear();
+        emergencyList.clear();
+        byDoctor.clear();
+        byDisease.clear();
+        bySeverity.clear();
+        names.clear();
+        namesBuilt = false;
+    }
+
+    // Lists are null where no patient ever had the value
+    const PostingList &all() const { return everyone; }
+    const PostingList &emergencies() const { return emergencyList; }
+    const PostingList *doctor(int doctorId) const { return find(byDoctor, doctorId + 1); }
+    const PostingList *disease(uint16_t code) const { return find(byDisease, code); }
+    const PostingList *severity(uint16_t code) const { return find(bySeverity, code); }
+    const NameTrie &nameTrie(const PatientStore &store) const
+    {
+        if (!namesBuilt)
+        {
+            for (Patient p : store)
+                names.insert(p.getName(), p.getId());
+            namesBuilt = true;
+        }
+        return names;
+    }
+};
+
+// Whole-census billing in one pass over the PatientStore columns. The tariff is flattened
+// into a dense [disease][severity] table with one trailing "no tariff" row and column, so
+// every patient costs the same branch-free arithmetic:
+//   bill = (rate[cell] + applies[cell] * surcharge[doctor + 1]) * scale[emergency]
+// where unknown cells hold the 500 default and applies = 0, and scale is {1, emergency
+// factor}. The result is bit-identical to Patient::calculateBill. Large passes are split
+// into contiguous row ranges, one per thread.
+class BillingEngine
+{
+private:
+    size_t diseaseCount;  // rows in the table, including the trailing no-tariff row
+    size_t severityCount; // columns, including the trailing no-tariff column
+    vector<double> rate;
+    vector<double> applies;
+    vector<double> surcharge; // by doctor ID + 1; slot 0 is "unassigned"
+    double scale[2];          // by emergency flag
+
+    static const size_t MIN_ROWS_PER_THREAD = 1 << 16;
+
+    // Raw column and table pointers for the inner loops. Copied into locals so the stores
+    // to the output array cannot force the compiler to reload them on every row.
+    struct Columns
+    {
+        const PatientId *ids;
+        const uint16_t *diseases;
+        const uint16_t *severities;
+        const int32_t *doctors;
+        const uint8_t *flags;
+        const double *rate;
+        const double *applies;
+        const double *surcharge;
+        const double *scale;
+        uint32_t lastDisease;
+        uint32_t lastSeverity;
+        uint32_t severityCount;
+
+        Columns(const PatientStore &store, const BillingEngine &engine)
+            : ids(store.idColumn().data()), diseases(store.diseaseColumn().data()), severities(store.severityColumn().data()),
+              doctors(store.doctorColumn().data()), flags(store.flagColumn().data()), rate(engine.rate.data()),
+              applies(engine.applies.data()), surcharge(engine.surcharge.data()), scale(engine.scale), lastDisease((uint32_t)engine.diseaseCount - 1),
+              lastSeverity((uint32_t)engine.severityCount - 1), severityCount((uint32_t)engine.severityCount) {}
+    };
+
+    // Bill for one row; 0 for a hole
+    static double billRow(const Columns &c, size_t row)
+    {
+        uint32_t cell = min<uint32_t>(c.diseases[row], c.lastDisease) * c.severityCount + min<uint32_t>(c.severities[row], c.lastSeverity);
+        double base = c.rate[cell] + c.applies[cell] * c.surcharge[c.doctors[row] + 1];
+        double bill = base * c.scale[c.flags[row] & PatientStore::EMERGENCY];
+        return bill * (c.ids[row] != 0); // holes bill as 0 without a branch
+    }
+
+    // Four independent accumulators, so the additions pipeline instead of waiting on each other
+    static double sum(const double *values, size_t n)
+    {
+        double acc[4] = {0, 0, 0, 0};
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            acc[0] += values[i];
+            acc[1] += values[i + 1];
+            acc[2] += values[i + 2];
+            acc[3] += values[i + 3];
+        }
+        for (; i < n; i++)
+            acc[0] += values[i];
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+    // Runs body(begin, end) over `count` items split into contiguous chunks, one per thread,
+    // and returns each chunk's result in order
+    template <typename Body>
+    static vector<double> split(size_t count, unsigned threads, Body body)
+    {
+        if (threads == 0)
+            threads = max(1u, thread::hardware_concurrency());
+        size_t chunks = max<size_t>(1, min<size_t>(threads, count / MIN_ROWS_PER_THREAD));
+        vector<double> partial(chunks, 0);
+        if (chunks == 1)
+        {
+            partial[0] = body(0, count);
+            return partial;
+        }
+
+        vector<thread> workers;
+        size_t step = (count + chunks - 1) / chunks;
+        for (size_t c = 1; c < chunks; c++)
+        {
+            size_t begin = c * step, end = min(count, begin + step);
+            workers.emplace_back([&partial, &body, c, begin, end]()
+                                 { partial[c] = body(begin, end); });
+        }
+        partial[0] = body(0, min(count, step));
+        for (auto &w : workers)
+            w.join();
+        return partial;
+    }
+
+public:
+    BillingEngine() : diseaseCount(1), severityCount(1), rate(1, TariffTable::DEFAULT_COST), applies(1, 0), surcharge(1, 0), scale{1.0, 1.5} {}
+
+    // Flattens the tariff and doctor surcharges; call again after either changes
+    void prepare(const TariffTable &tariffs, const DoctorRegistry &registry)
+    {
+        diseaseCount = tariffs.diseaseCost.size() + 1;
+        severityCount = tariffs.severityMultiplier.size() + 1;
+        rate.assign(diseaseCount * severityCount, TariffTable::DEFAULT_COST);
+        applies.assign(diseaseCount * severityCount, 0);
+        for (size_t d = 0; d + 1 < diseaseCount; d++)
+        {
+            for (size_t s = 0; s + 1 < severityCount; s++)
+            {
+                double cost = tariffs.diseaseCost[d], multiplier = tariffs.severityMultiplier[s];
+                if (cost < 0 || multiplier < 0)
+                    continue;
+                rate[d * severityCount + s] = cost * multiplier;
+                applies[d * severityCount + s] = 1;
+            }
+        }
+
+        surcharge.assign(registry.size() + 1, 0);
+        for (int id = 0; id < registry.size(); id++)
+            surcharge[id + 1] = registry.surchargeOf(id);
+        scale[1] = tariffs.emergencyFactor;
+    }
+
+    // Bills every row of the store; bills[row] pairs with store.id(row), and holes get 0.
+    // Returns the total of all bills.
+    double billAll(const PatientStore &store, vector<double> &bills, unsigned threads = 0) const
+    {
+        bills.resize(store.rows());
+        double *out = bills.data();
+        const Columns columns(store, *this);
+        vector<double> partial = split(store.rows(), threads, [&](size_t begin, size_t end)
+                                       {
+                                           // Kept apart from the sum so the compiler can vectorize it
+                                           for (size_t row = begin; row < end; row++)
+                                               out[row] = billRow(columns, row);
+                                           return sum(out + begin, end - begin); });
+        double total = 0;
+        for (double p : partial)
+            total += p;
+        return total;
+    }
+
+    // Bills the given rows only; bills[i] pairs with rows[i]. Returns their total.
+    double billRows(const PatientStore &store, const vector<uint32_t> &rows, vector<double> &bills, unsigned threads = 0) const
+    {
+        bills.resize(rows.size());
+        double *out = bills.data();
+        const Columns columns(store, *this);
+        vector<double> partial = split(rows.size(), threads, [&](size_t begin, size_t end)
+                                       {
+                                           for (size_t i = begin; i < end; i++)
+                                               out[i] = billRow(columns, rows[i]);
+                                           return sum(out + begin, end - begin); });
+        double total = 0;
+        for (double p : partial)
+            total += p;
+        return total;
+    }
+
+    // Sums bills already worked out, e.g. a PatientStore's cached bill column, in the same
+    // order as billAll(), so the two give the same total
+    static double total(const vector<double> &bills, unsigned threads = 0)
+    {
+        const double *values = bills.data();
+        vector<double> partial = split(bills.size(), threads, [&](size_t begin, size_t end)
+                                       { return sum(values + begin, end - begin); });
+        double total = 0;
+        for (double p : partial)
+            total += p;
+        return total;
+    }
+};
+
+// Room management
+const int TOTAL_ROOMS = 100;
+
+// Tracks room occupancy as a bitmap packed into 64-bit words, plus a summary
+// level with one bit per word that still has a free room. Finding the lowest
+// free room skips full words 64 at a time via the summary and then uses
+// count-trailing-zeros, so admissions no longer scan every room.
+//
+// allocate, reserve and release may run concurrently: a room is claimed by a
+// compare-and-swap on its word, so no two callers ever get the same room. The
+// summary is only a hint; a claim that races with a release can leave a word's
+// hint clear for a moment, which allocate covers with a full scan before it
+// reports the hospital full. Resizing, loading, partitioning and the bulk calls
+// must not overlap any other call.
+//
+// The rooms can be partitioned into zones of consecutive rooms (the wards of a
+// WardTopology), each with its own free count. allocateIn searches only its
+// zone's words and skips a full zone on that count alone, so claiming a room in
+// a zone costs the same however large the rest of the hospital is.
+class RoomAllocator
+{
+private:
+    int capacity;
+    atomic<int> freeCount;
+    size_t wordCount;
+    unique_ptr<atomic<uint64_t>[]> occupied; // bit set = room occupied (bits past capacity are kept set)
+    unique_ptr<atomic<uint64_t>[]> hasFree;  // bit w set = occupied[w] has at least one clear bit
+    vector<int> zoneStart{0, 0};             // zone z holds rooms [zoneStart[z], zoneStart[z + 1])
+    unique_ptr<atomic<int>[]> zoneFree;      // free rooms per zone
+
+    static int lowestBit(uint64_t x) { return __builtin_ctzll(x); }
+    size_t summaryWords() const { return (wordCount + 63) / 64; }
+
+    int zoneOf(int room) const
+    {
+        return (int)(upper_bound(zoneStart.begin() + 1, zoneStart.end() - 1, room) - zoneStart.begin()) - 1;
+    }
+
+    // Counts every zone's free rooms again from the bitmap
+    void recountZones()
+    {
+        for (size_t z = 0; z + 1 < zoneStart.size(); z++)
+        {
+            int free = 0;
+            for (int room = zoneStart[z]; room < zoneStart[z + 1]; room++)
+                free += !((occupied[room >> 6].load(memory_order_relaxed) >> (room & 63)) & 1);
+            zoneFree[z].store(free, memory_order_relaxed);
+        }
+    }
+
+    void refreshSummary(size_t word)
+    {
+        uint64_t bit = 1ULL << (word & 63);
+        if (~occupied[word].load())
+        {
+            hasFree[word >> 6].fetch_or(bit);
+            return;
+        }
+        hasFree[word >> 6].fetch_and(~bit);
+        // A release between the load and the clear has already set the bit; restore it
+        if (~occupied[word].load())
+            hasFree[word >> 6].fetch_or(bit);
+    }
+
+    // Sizes the arrays for n rooms, all occupied until the caller frees them
+    void reallocate(int n)
+    {
+        capacity = n < 0 ? 0 : n;
+        wordCount = (capacity + 63) / 64;
+        occupied.reset(new atomic<uint64_t>[wordCount]);
+        hasFree.reset(new atomic<uint64_t>[summaryWords()]);
+        for (size_t w = 0; w < wordCount; w++)
+            occupied[w].store(~0ULL, memory_order_relaxed);
+        for (size_t s = 0; s < summaryWords(); s++)
+            hasFree[s].store(0, memory_order_relaxed);
+        freeCount = 0;
+        if (zoneStart.back() != capacity)
+            zoneStart = {0, capacity}; // a new size drops the old zones
+        zoneFree.reset(new atomic<int>[zoneStart.size() - 1]);
+        for (size_t z = 0; z + 1 < zoneStart.size(); z++)
+            zoneFree[z].store(0, memory_order_relaxed);
+    }
+
+    // Takes the lowest clear bit of `word` among the `allowed` bits; returns the room or -1
+    // once none of them is clear
+    int claimIn(size_t word, uint64_t allowed = ~0ULL)
+    {
+        uint64_t bits = occupied[word].load();
+        while (~bits & allowed)
+        {
+            uint64_t candidates = ~bits & allowed;
+            uint64_t bit = candidates & (~candidates + 1); // lowest allowed clear bit
+            if (occupied[word].compare_exchange_weak(bits, bits | bit))
+            {
+                int room = (int)(word * 64 + lowestBit(bit));
+                freeCount.fetch_sub(1);
+                zoneFree[zoneOf(room)].fetch_sub(1);
+                refreshSummary(word);
+                return room;
+            }
+        }
+        return -1;
+    }
+
+public:
+    explicit RoomAllocator(int n = TOTAL_ROOMS) : capacity(0), freeCount(0), wordCount(0) { reset(n); }
+    RoomAllocator(const RoomAllocator &) = delete;
+    RoomAllocator &operator=(const RoomAllocator &) = delete;
+
+    // Replaces the hospital with `n` free rooms
+    void reset(int n)
+    {
+        reallocate(n);
+        for (int room = 0; room < capacity; room++)
+            occupied[room >> 6].fetch_and(~(1ULL << (room & 63)), memory_order_relaxed);
+        freeCount = capacity;
+        for (size_t w = 0; w < wordCount; w++)
+            refreshSummary(w);
+        recountZones();
+    }
+
+    // Grows or shrinks the hospital; new rooms start free
+    void resize(int n)
+    {
+        vector<uint64_t> old = bitmap();
+        int oldCapacity = capacity;
+
+        reallocate(n);
+        int freed = 0;
+        for (int room = 0; room < capacity; room++)
+        {
+            bool taken = room < oldCapacity && (old[room >> 6] >> (room & 63)) & 1;
+            if (!taken)
+            {
+                occupied[room >> 6].fetch_and(~(1ULL << (room & 63)), memory_order_relaxed);
+                freed++;
+            }
+        }
+        freeCount = freed;
+        for (size_t w = 0; w < wordCount; w++)
+            refreshSummary(w);
+        recountZones();
+    }
+
+    // Occupancy words for persistence; bits past the last room are always set
+    vector<uint64_t> bitmap() const
+    {
+        vector<uint64_t> words(wordCount);
+        for (size_t w = 0; w < wordCount; w++)
+            words[w] = occupied[w].load();
+        return words;
+    }
+
+    // Replaces the whole occupancy state with `n` rooms read from a saved bitmap
+    void loadBitmap(const uint64_t *words, int n)
+    {
+        reallocate(n);
+        int freed = 0;
+        for (size_t w = 0; w < wordCount; w++)
+        {
+            uint64_t bits = words[w];
+            if (w == wordCount - 1 && capacity % 64)
+                bits |= ~0ULL << (capacity % 64);
+            occupied[w].store(bits, memory_order_relaxed);
+            freed += __builtin_popcountll(~bits);
+        }
+        freeCount = freed;
+        for (size_t w = 0; w < wordCount; w++)
+            refreshSummary(w);
+        recountZones();
+    }
+
+    // Splits the rooms into zones; `starts` holds each zone's first room and then the room
+    // count. Returns false, leaving the zones as they were, if it does not cover every room.
+    bool partition(const vector<int> &starts)
+    {
+        if (starts.size() < 2 || starts.front() != 0 || starts.back() != capacity || !is_sorted(starts.begin(), starts.end()))
+            return false;
+        zoneStart = starts;
+        zoneFree.reset(new atomic<int>[zoneStart.size() - 1]);
+        recountZones();
+        return true;
+    }
+
+    int size() const { return capacity; }
+    int available() const { return freeCount.load(); }
+    bool isValid(int room) const { return room >= 0 && room < capacity; }
+    int zones() const { return (int)zoneStart.size() - 1; }
+    int availableIn(int zone) const { return zone >= 0 && zone < zones() ? zoneFree[zone].load() : 0; }
+
+    bool isOccupied(int room) const
+    {
+        return isValid(room) && ((occupied[room >> 6].load() >> (room & 63)) & 1);
+    }
+
+    // Returns the lowest free room index, or -1 if the hospital is full. Another thread may
+    // claim the room before the caller does; use allocate() to claim one.
+    int findFree() const
+    {
+        for (size_t s = 0; s < summaryWords(); s++)
+        {
+            uint64_t hint = hasFree[s].load();
+            for (; hint; hint &= hint - 1)
+            {
+                size_t word = s * 64 + lowestBit(hint);
+                uint64_t bits = occupied[word].load();
+                if (~bits)
+                    return (int)(word * 64 + lowestBit(~bits));
+            }
+        }
+        return -1;
+    }
+
+    // Claims the lowest free room; returns -1 if none is available
+    int allocate()
+    {
+        for (size_t s = 0; s < summaryWords(); s++)
+        {
+            uint64_t hint = hasFree[s].load();
+            for (; hint; hint &= hint - 1)
+            {
+                int room = claimIn(s * 64 + lowestBit(hint));
+                if (room != -1)
+                    return room;
+            }
+        }
+        // The hints can briefly miss a room freed during the scan above
+        if (freeCount.load() > 0)
+        {
+            for (size_t w = 0; w < wordCount; w++)
+            {
+                int room = claimIn(w);
+                if (room != -1)
+                    return room;
+            }
+        }
+        return -1;
+    }
+
+    // Claims the lowest free room of `zone`; returns -1 if the zone is full
+    int allocateIn(int zone)
+    {
+        if (zone < 0 || zone >= zones() || zoneFree[zone].load() <= 0)
+            return -1;
+        int first = zoneStart[zone], end = zoneStart[zone + 1];
+        size_t firstWord = first >> 6, lastWord = (end - 1) >> 6;
+        auto allowed = [&](size_t word)
+        {
+            uint64_t mask = ~0ULL;
+            if (word == firstWord)
+                mask &= ~0ULL << (first & 63);
+            if (word == lastWord && (end & 63))
+                mask &= ~0ULL >> (64 - (end & 63));
+            return mask;
+        };
+        for (size_t s = firstWord >> 6; s <= lastWord >> 6; s++)
+        {
+            uint64_t hint = hasFree[s].load();
+            if (s == firstWord >> 6)
+                hint &= ~0ULL << (firstWord & 63);
+            if (s == lastWord >> 6)
+                hint &= ~0ULL >> (63 - (lastWord & 63));
+            for (; hint; hint &= hint - 1)
+            {
+                size_t word = s * 64 + lowestBit(hint);
+                int room = claimIn(word, allowed(word));
+                if (room != -1)
+                    return room;
+            }
+        }
+        // The hints can briefly miss a room freed during the scan above
+        if (zoneFree[zone].load() > 0)
+        {
+            for (size_t w = firstWord; w <= lastWord; w++)
+            {
+                int room = claimIn(w, allowed(w));
+                if (room != -1)
+                    return room;
+            }
+        }
+        return -1;
+    }
+
+    // Marks a specific room occupied; returns false if it was already taken or out of range
+    bool reserve(int room)
+    {
+        if (!isValid(room))
+            return false;
+        uint64_t bit = 1ULL << (room & 63);
+        if (occupied[room >> 6].fetch_or(bit) & bit)
+            return false;
+        freeCount.fetch_sub(1);
+        zoneFree[zoneOf(room)].fetch_sub(1);
+        refreshSummary(room >> 6);
+        return true;
+    }
+
+    void release(int room)
+    {
+        if (!isValid(room))
+            return;
+        uint64_t bit = 1ULL << (room & 63);
+        if (!(occupied[room >> 6].fetch_and(~bit) & bit))
+            return;
+        freeCount.fetch_add(1);
+        zoneFree[zoneOf(room)].fetch_add(1);
+        refreshSummary(room >> 6);
+    }
+
+    // Claims up to `count` of the lowest free rooms in one pass, taking whole words at a time
+    // where possible. Returns the claimed rooms in ascending order.
+    vector<int> reserveBulk(int count)
+    {
+        vector<int> claimed;
+        claimed.reserve(min(count, available()));
+        for (size_t s = 0; s < summaryWords() && (int)claimed.size() < count; s++)
+        {
+            while (hasFree[s].load() && (int)claimed.size() < count)
+            {
+                size_t word = s * 64 + lowestBit(hasFree[s].load());
+                uint64_t bits = occupied[word].load();
+                uint64_t freeBits = ~bits;
+                while (freeBits && (int)claimed.size() < count)
+                {
+                    int bit = lowestBit(freeBits);
+                    freeBits &= freeBits - 1;
+                    bits |= 1ULL << bit;
+                    claimed.push_back((int)(word * 64 + bit));
+                }
+                occupied[word].store(bits);
+                refreshSummary(word);
+            }
+        }
+        freeCount.fetch_sub((int)claimed.size());
+        recountZones();
+        return claimed;
+    }
+
+    void releaseBulk(const vector<int> &roomList)
+    {
+        for (int room : roomList)
+            release(room);
+    }
+};
+
+enum class RoomType : uint8_t
+{
+    General,
+    ICU,
+    Isolation
+};
+
+const char *roomTypeName(RoomType type)
+{
+    switch (type)
+    {
+    case RoomType::ICU:
+        return "icu";
+    case RoomType::Isolation:
+        return "isolation";
+    default:
+        return "general";
+    }
+}
+
+// Reads "general", "icu" or "isolation" in any case
+bool parseRoomType(string_view name, RoomType &type)
+{
+    string lower(name);
+    for (auto &c : lower)
+        c = (char)tolower((unsigned char)c);
+    for (RoomType t : {RoomType::General, RoomType::ICU, RoomType::Isolation})
+    {
+        if (lower == roomTypeName(t))
+        {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// One ward as configured or saved: `rooms` consecutive rooms of one type on one floor
+struct WardSpec
+{
+    string name;
+    int floor = 1;
+    RoomType type = RoomType::General;
+    int rooms = 0;
+    bool emergency = false; // takes emergency admissions first
+    vector<string> doctors; // doctors based on this ward, by name
+};
+
+// The hospital's wards laid over the room indices in order: ward w holds rooms
+// [firstRoom(w), endRoom(w)), which RoomAllocator tracks as zone w. Fixed once built; a
+// Hospital shares it with its checkpoints and only swaps in another while held exclusively.
+//
+// For every ward, and for patients whose doctor has no ward, the wards are kept sorted
+// nearest first: the ward itself, then by floors apart, then in ward order. That costs
+// wards^2 ints, which is small for any real hospital, and makes placement a walk down one
+// list that usually stops at its first ward.
+class WardTopology
+{
+private:
+    vector<WardSpec> wards;
+    vector<int> starts;          // first room of each ward, then the room count
+    vector<vector<int>> nearest; // by home ward; the last list is for no home ward
+
+public:
+    explicit WardTopology(vector<WardSpec> specs) : wards(move(specs))
+    {
+        starts.reserve(wards.size() + 1);
+        starts.push_back(0);
+        for (auto &w : wards)
+            starts.push_back(starts.back() + w.rooms);
+
+        vector<int> order(wards.size());
+        for (size_t w = 0; w < wards.size(); w++)
+            order[w] = (int)w;
+        nearest.assign(wards.size() + 1, order);
+        for (size_t home = 0; home < wards.size(); home++)
+        {
+            auto distance = [&](int w)
+            { return make_pair(w != (int)home, abs(wards[w].floor - wards[home].floor)); };
+            stable_sort(nearest[home].begin(), nearest[home].end(), [&](int a, int b)
+                        { return distance(a) < distance(b); });
+        }
+    }
+
+    // The layout of a hospital without configured wards: one emergency-capable general ward
+    static WardTopology single(int rooms)
+    {
+        WardSpec ward;
+        ward.name = "General";
+        ward.rooms = rooms;
+        ward.emergency = true;
+        return WardTopology({ward});
+    }
+
+    int size() const { return (int)wards.size(); }
+    int rooms() const { return starts.back(); }
+    const WardSpec &ward(int w) const { return wards[w]; }
+    const vector<WardSpec> &all() const { return wards; }
+    const vector<int> &roomStarts() const { return starts; }
+    int firstRoom(int w) const { return starts[w]; }
+    int endRoom(int w) const { return starts[w + 1]; }
+
+    // Returns -1 for a room index outside every ward
+    int wardOf(int room) const
+    {
+        if (room < 0 || room >= rooms())
+            return -1;
+        return (int)(upper_bound(starts.begin(), starts.end(), room) - starts.begin()) - 1;
+    }
+
+    // Returns -1 if no ward has this name
+    int find(string_view name) const
+    {
+        for (size_t w = 0; w < wards.size(); w++)
+            if (wards[w].name == name)
+                return (int)w;
+        return -1;
+    }
+
+    // Claims a room for a patient whose doctor is based on ward `home` (-1 for none), trying
+    // wards nearest to `home` first. An emergency tries the emergency-capable wards first;
+    // anyone else tries the home ward and then the wards that do not take emergencies, which
+    // keeps those free for emergencies. Both then overflow into the remaining wards, so -1
+    // means the hospital is full. `rooms` must be partitioned by roomStarts().
+    int place(RoomAllocator &rooms, bool emergency, int home) const
+    {
+        const vector<int> &order = nearest[home >= 0 && home < size() ? home : size()];
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (int w : order)
+            {
+                bool preferred = wards[w].emergency == emergency || (!emergency && w == home);
+                if (preferred != (pass == 0))
+                    continue;
+                int room = rooms.allocateIn(w);
+                if (room != -1)
+                    return room;
+            }
+        }
+        return -1;
+    }
+};
+
+// One ward's line in a ward report
+struct WardOccupancy
+{
+    string name;
+    int floor;
+    RoomType type;
+    bool emergency;
+    int rooms;
+    int free;
+    int doctors; // doctors based on the ward
+};
+
+// The patient in each room, for room-range queries. Entries are written under the patient's
+// shard lock and read without one, so a reader confirms an entry against the census before
+// trusting it. Resized only while the hospital is held exclusively.
+class RoomOccupants
+{
+private:
+    unique_ptr<atomic<PatientId>[]> ids;
+    int count = 0;
+
+public:
+    // Sizes the table and forgets every occupant
+    void reset(int rooms)
+    {
+        count = max(0, rooms);
+        ids.reset(new atomic<PatientId>[count]);
+        for (int i = 0; i < count; i++)
+            ids[i].store(0, memory_order_relaxed);
+    }
+
+    // Room numbers are 1-based; rooms outside the table are ignored
+    void set(int room, PatientId id)
+    {
+        if (room >= 1 && room <= count)
+            ids[room - 1].store(id, memory_order_relaxed);
+    }
+
+    void clear(int room, PatientId id)
+    {
+        if (room >= 1 && room <= count)
+            ids[room - 1].compare_exchange_strong(id, 0, memory_order_relaxed);
+    }
+
+    PatientId at(int room) const { return room >= 1 && room <= count ? ids[room - 1].load(memory_order_relaxed) : 0; }
+    int size() const { return count; }
+};
+
+// On-disk formats for the hospital state
+enum class SnapshotFormat
+{
+    Text,  // line-per-field hospital_data.txt, kept for import/export
+    Binary // versioned, memory-mapped hospital_data.bin
+};
+
+// Binary snapshot layout (native byte order, every section 8-byte aligned):
+//   SnapshotHeader
+//   string table    - deduplicated strings, referenced by (offset, length)
+//   doctor records  - SnapshotDoctor[doctorCount]
+//   specialty refs  - SnapshotString[specialtyCount]
+//   patient records - SnapshotPatient[patientCount]
+//   room bitmap     - uint64_t[(roomCount + 63) / 64], bit set = occupied
+//   ward records    - SnapshotWard[wardCount], covering the rooms in order
+//   ward doctors    - SnapshotString[wardDoctorCount]
+// Version 3 files end after the room bitmap and have a 96-byte header with no ward fields;
+// they still load, with the wards a fresh hospital would get.
+const char SNAPSHOT_MAGIC[8] = {'H', 'M', 'S', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 4;
+const uint32_t SNAPSHOT_VERSION_NO_WARDS = 3;
+const uint32_t SNAPSHOT_NO_WARDS_HEADER_SIZE = 96;
+const uint32_t SNAPSHOT_EMERGENCY = 1; // SnapshotPatient::flags and SnapshotWard::flags
+
+struct SnapshotString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t generation; // bumped on every save; matches the journal written on top of it
+    uint64_t stringTableOffset;
+    uint64_t stringTableSize;
+    uint64_t doctorOffset;
+    uint64_t specialtyOffset;
+    uint64_t patientOffset;
+    uint64_t roomOffset;
+    uint32_t doctorCount;
+    uint32_t specialtyCount;
+    uint32_t patientCount;
+    uint32_t roomCount;
+    uint32_t nextPatientId;
+    uint32_t wardCount; // 0 in version 3
+    // Version 4 from here on
+    uint64_t wardOffset;
+    uint64_t wardDoctorOffset;
+    uint32_t wardDoctorCount;
+    uint32_t reserved;
+};
+
+struct SnapshotDoctor
+{
+    SnapshotString name;
+    uint32_t firstSpecialty;
+    uint32_t specialtyCount;
+    int32_t patientCount;
+    uint32_t reserved;
+    double surcharge;
+};
+
+struct SnapshotPatient
+{
+    SnapshotString name;
+    SnapshotString disease;
+    SnapshotString severity;
+    int32_t doctor; // index into the snapshot's doctor records, -1 if unassigned
+    int32_t roomNumber;
+    uint32_t flags;
+    uint32_t id;
+};
+
+struct SnapshotWard
+{
+    SnapshotString name;
+    int32_t floor;
+    uint32_t rooms;
+    uint32_t firstDoctor; // into the ward doctor refs
+    uint32_t doctorCount;
+    uint8_t type; // RoomType
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+static_assert(sizeof(SnapshotHeader) == 120, "snapshot header layout changed");
+static_assert(sizeof(SnapshotWard) == 32, "snapshot ward layout changed");
+static_assert(sizeof(SnapshotDoctor) == 32, "snapshot doctor layout changed");
+static_assert(sizeof(SnapshotPatient) == 40, "snapshot patient layout changed");
+
+// Builds the deduplicated string table while a snapshot is being written
+class SnapshotStringTable
+{
+private:
+    string data;
+    unordered_map<string, SnapshotString> offsets;
+
+public:
+    SnapshotString add(const string &s)
+    {
+        auto it = offsets.find(s);
+        if (it != offsets.end())
+            return it->second;
+        SnapshotString ref = {(uint32_t)data.size(), (uint32_t)s.size()};
+        data += s;
+        offsets[s] = ref;
+        return ref;
+    }
+
+    const string &bytes() const { return data; }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+    const char *base;
+    size_t length;
+
+public:
+    explicit MappedFile(const string &path) : base(nullptr), length(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                base = (const char *)p;
+                length = st.st_size;
+            }
+        }
+        close(fd);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile()
+    {
+        if (base)
+            munmap((void *)base, length);
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+
+    // True if [offset, offset + bytes) lies inside the file
+    bool contains(uint64_t offset, uint64_t bytes) const
+    {
+        return offset <= length && bytes <= length - offset;
+    }
+};
+
+// Reads lines out of an in-memory file the way getline reads them from a stream: '\n' ends
+// a line and is not part of it, and the last line needs no '\n'. Past the end every line
+// comes back empty.
+class LineCursor
+{
+private:
+    const char *pos;
+    const char *end;
+    size_t number; // 1-based number of the next line
+
+public:
+    LineCursor(const char *begin, const char *finish, size_t firstLine = 1) : pos(begin), end(finish), number(firstLine) {}
+
+    size_t line() const { return number; }
+
+    // False, with an empty line, once the input is used up
+    bool next(string_view &out)
+    {
+        if (pos == end)
+        {
+            out = string_view();
+            return false;
+        }
+        const char *newline = (const char *)memchr(pos, '\n', end - pos);
+        const char *stop = newline ? newline : end;
+        out = string_view(pos, stop - pos);
+        pos = newline ? newline + 1 : end;
+        number++;
+        return true;
+    }
+
+    // Skips up to n lines and returns how many there were
+    size_t skip(size_t n)
+    {
+        string_view ignored;
+        size_t skipped = 0;
+        while (skipped < n && next(ignored))
+            skipped++;
+        return skipped;
+    }
+};
+
+// Strips leading and trailing whitespace
+string_view trimField(string_view field)
+{
+    while (!field.empty() && isspace((unsigned char)field.front()))
+        field.remove_prefix(1);
+    while (!field.empty() && isspace((unsigned char)field.back()))
+        field.remove_suffix(1);
+    return field;
+}
+
+// Splits a line of a roster or ward file into its trimmed '|'-separated fields
+void splitFields(string_view line, vector<string_view> &fields)
+{
+    fields.clear();
+    for (size_t start = 0;;)
+    {
+        size_t bar = line.find('|', start);
+        fields.push_back(trimField(line.substr(start, bar == string_view::npos ? string_view::npos : bar - start)));
+        if (bar == string_view::npos)
+            break;
+        start = bar + 1;
+    }
+}
+
+// A malformed part of a text save, by line
+struct LoadWarning
+{
+    size_t line;
+    string message;
+};
+
+// One PATIENTS record of hospital_data.txt as parsed, before it joins the census. The
+// views point into the file.
+struct TextPatient
+{
+    bool emergency;
+    PatientId id; // 0 for a fresh one
+    string_view name, disease, severity;
+    int doctorId;
+    int roomNumber;
+};
+
+// Lines per PATIENTS record: the marker, name, disease, doctor, severity and room
+const size_t TEXT_PATIENT_LINES = 6;
+
+// Parses up to `count` records from `cursor` the way the text format has always been read:
+// an unknown marker skips the five lines after it, and a record cut short by the end of the
+// file is kept with its missing fields empty. Safe to run on several threads at once.
+void parseTextPatients(LineCursor cursor, size_t count, const DoctorRegistry &doctors, vector<TextPatient> &out, vector<LoadWarning> &warnings)
+{
+    string_view marker;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t line = cursor.line();
+        if (!cursor.next(marker))
+            break;
+
+        // Markers carry the patient ID ("PATIENT 17"); records saved before IDs existed get fresh ones
+        TextPatient rec = {};
+        string_view type = marker;
+        size_t space = marker.find(' ');
+        if (space != string_view::npos)
+        {
+            bool ok;
+            rec.id = (PatientId)max(0, parseInt(marker.substr(space + 1), 0, &ok));
+            if (!ok)
+                warnings.push_back({line, "patient ID \"" + string(marker.substr(space + 1)) + "\" is not a number; a new ID is assigned"});
+            type = marker.substr(0, space);
+        }
+        if (type != "EMERGENCY" && type != "PATIENT")
+        {
+            warnings.push_back({line, "unknown record type \"" + string(type) + "\"; record skipped"});
+            cursor.skip(TEXT_PATIENT_LINES - 1);
+            continue;
+        }
+
+        rec.emergency = type == "EMERGENCY";
+        string_view doctor, room;
+        bool complete = cursor.next(rec.name) && cursor.next(rec.disease) && cursor.next(doctor) && cursor.next(rec.severity) && cursor.next(room);
+        bool ok;
+        rec.roomNumber = parseInt(room, 0, &ok);
+        if (!complete)
+            warnings.push_back({line, "record cut short by the end of the file"});
+        else if (!ok)
+            warnings.push_back({line, "room \"" + string(room) + "\" is not a number; room 0 assumed"});
+        rec.doctorId = doctors.findId(doctor);
+        if (rec.doctorId == -1 && !doctor.empty())
+            warnings.push_back({line, "doctor \"" + string(doctor) + "\" is not on the roster; patient left unassigned"});
+        out.push_back(rec);
+    }
+}
+
+// Write-ahead journal of admissions and discharges made since the last snapshot.
+//
+// File layout: JournalHeader, then records of
+//   uint32 payload length | uint32 FNV-1a checksum of payload | payload
+// Each record is written to the file as soon as it is appended, so it survives a process
+// crash. fdatasync is batched (group commit): it runs once `groupCommitRecords` records or
+// `groupCommitMillis` have accumulated, and on sync()/close. The header carries the
+// generation of the snapshot the records apply to. A checkpoint record marks the point a
+// background snapshot was captured at: until that snapshot is on disk the whole journal
+// still applies to the old one, and a crash after it landed but before the journal was cut
+// down replays only the records after the marker.
+const char JOURNAL_MAGIC[8] = {'H', 'M', 'S', 'J', 'R', 'N', 'L', '\0'};
+const uint32_t JOURNAL_VERSION = 3; // 2 had no checkpoint records and is still read
+
+struct JournalHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t generation;
+};
+
+enum class JournalOp : uint8_t
+{
+    Admit = 1,
+    AdmitEmergency = 2,
+    Discharge = 3,
+    Checkpoint = 4
+};
+
+struct JournalEntry
+{
+    JournalOp op;
+    PatientId patientId;
+    string name;
+    string disease;
+    string severity;
+    string doctor;
+    int32_t roomNumber;
+    uint64_t generation; // Checkpoint only
+};
+
+// Flushes a fully written temporary file to disk and moves it over `path`, so readers see
+// either the old file or the complete new one, even across a crash
+bool replaceFile(const string &tempPath, const string &path)
+{
+    int fd = ::open(tempPath.c_str(), O_RDONLY);
+    bool ok = fd != -1 && fsync(fd) == 0;
+    if (fd != -1)
+        ::close(fd);
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+    // Make the rename itself durable
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int dirFd = ::open(dir.c_str(), O_RDONLY);
+    if (dirFd != -1)
+    {
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+    return true;
+}
+
+class Journal
+{
+private:
+    int fd;
+    string path;
+    int groupCommitRecords;
+    chrono::milliseconds groupCommitInterval;
+    int unsynced;
+    chrono::steady_clock::time_point firstUnsynced;
+    uint64_t recordCount;
+    off_t checkpointEnd;         // file offset just past the pending checkpoint record, or -1
+    uint64_t checkpointRecords;  // records up to and including it
+
+    static uint32_t checksum(const string &bytes)
+    {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : bytes)
+            h = (h ^ c) * 16777619u;
+        return h;
+    }
+
+    static void putU32(string &out, uint32_t v) { out.append((const char *)&v, sizeof(v)); }
+    static void putString(string &out, const string &s)
+    {
+        putU32(out, (uint32_t)s.size());
+        out += s;
+    }
+
+    static bool getU32(const string &in, size_t &pos, uint32_t &v)
+    {
+        if (in.size() - pos < sizeof(v))
+            return false;
+        memcpy(&v, in.data() + pos, sizeof(v));
+        pos += sizeof(v);
+        return true;
+    }
+    static bool getString(const string &in, size_t &pos, string &s)
+    {
+        uint32_t len;
+        if (!getU32(in, pos, len) || in.size() - pos < len)
+            return false;
+        s.assign(in, pos, len);
+        pos += len;
+        return true;
+    }
+
+    static bool decode(const string &payload, JournalEntry &e)
+    {
+        if (payload.empty())
+            return false;
+        size_t pos = 1;
+        e.op = (JournalOp)payload[0];
+        if (!getU32(payload, pos, e.patientId))
+            return false;
+        uint32_t v;
+        switch (e.op)
+        {
+        case JournalOp::Admit:
+        case JournalOp::AdmitEmergency:
+            if (!getString(payload, pos, e.name) || !getString(payload, pos, e.disease) ||
+                !getString(payload, pos, e.severity) || !getString(payload, pos, e.doctor) ||
+                !getU32(payload, pos, v))
+                return false;
+            e.roomNumber = (int32_t)v;
+            return pos == payload.size();
+        case JournalOp::Discharge:
+            return pos == payload.size();
+        case JournalOp::Checkpoint:
+            if (!getU32(payload, pos, v))
+                return false;
+            e.generation = v;
+            if (!getU32(payload, pos, v))
+                return false;
+            e.generation |= (uint64_t)v << 32;
+            return pos == payload.size();
+        }
+        return false;
+    }
+
+    bool writeAll(const char *bytes, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, bytes, size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Replaces the file with a header for `generation` followed by `records`, through a
+    // temporary file, and reopens it for appending
+    bool rewrite(uint64_t generation, const char *records, size_t size)
+    {
+        string temp = path + ".tmp";
+        int out = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out == -1)
+            return false;
+        swap(fd, out);
+        bool ok = writeHeader(generation) && writeAll(records, size);
+        swap(fd, out);
+        ::close(out);
+        if (!ok || !replaceFile(temp, path))
+            return false;
+        ::close(fd);
+        fd = ::open(path.c_str(), O_RDWR);
+        return fd != -1 && lseek(fd, 0, SEEK_END) != (off_t)-1;
+    }
+
+    bool writeHeader(uint64_t generation)
+    {
+        JournalHeader header = {};
+        memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+        header.version = JOURNAL_VERSION;
+        header.generation = generation;
+        return ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0 &&
+               writeAll((const char *)&header, sizeof(header)) && fdatasync(fd) == 0;
+    }
+
+    bool append(const string &payload)
+    {
+        if (fd == -1)
+            return false;
+        string record;
+        record.reserve(8 + payload.size());
+        putU32(record, (uint32_t)payload.size());
+        putU32(record, checksum(payload));
+        record += payload;
+        if (!writeAll(record.data(), record.size()))
+            return false;
+
+        recordCount++;
+        auto now = chrono::steady_clock::now();
+        if (unsynced++ == 0)
+            firstUnsynced = now;
+        if (unsynced >= groupCommitRecords || now - firstUnsynced >= groupCommitInterval)
+            sync();
+        return true;
+    }
+
+public:
+    Journal(int commitRecords = 64, int commitMillis = 50)
+        : fd(-1), groupCommitRecords(max(1, commitRecords)), groupCommitInterval(commitMillis), unsynced(0), recordCount(0),
+          checkpointEnd(-1), checkpointRecords(0) {}
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+    ~Journal() { close(); }
+
+    // Opens the journal for appending on top of snapshot `generation`. Intact records that
+    // belong to that generation are returned in `pending` for replay; a torn tail left by a
+    // crash is cut off. A journal written on top of the previous generation applies from
+    // its last checkpoint record for `generation`, and is rewritten to start there. A
+    // missing, stale or unreadable journal is started afresh.
+    bool open(const string &journalPath, uint64_t generation, vector<JournalEntry> &pending)
+    {
+        close();
+        path = journalPath;
+        pending.clear();
+        checkpointEnd = -1;
+
+        string contents;
+        {
+            ifstream in(path, ios::binary);
+            if (in)
+                contents.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd == -1)
+            return false;
+
+        JournalHeader header;
+        bool current = contents.size() >= sizeof(header);
+        if (current)
+        {
+            memcpy(&header, contents.data(), sizeof(header));
+            current = memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) == 0 &&
+                      (header.version == JOURNAL_VERSION || header.version == 2) &&
+                      (header.generation == generation || header.generation + 1 == generation);
+        }
+        if (!current)
+            return writeHeader(generation);
+
+        size_t pos = sizeof(header);
+        size_t applyFrom = pos;
+        bool marked = header.generation == generation;
+        while (true)
+        {
+            size_t start = pos;
+            uint32_t length, sum;
+            JournalEntry e;
+            if (!getU32(contents, pos, length) || !getU32(contents, pos, sum) || contents.size() - pos < length)
+            {
+                pos = start;
+                break;
+            }
+            string payload = contents.substr(pos, length);
+            if (checksum(payload) != sum || !decode(payload, e))
+            {
+                pos = start;
+                break;
+            }
+            pos += length;
+            if (e.op != JournalOp::Checkpoint)
+                pending.push_back(e);
+            else if (e.generation == generation && header.generation != generation)
+            {
+                // The snapshot this marks was written; only what followed it still applies
+                pending.clear();
+                applyFrom = pos;
+                marked = true;
+            }
+        }
+        if (!marked)
+        {
+            pending.clear();
+            return writeHeader(generation);
+        }
+        recordCount = pending.size();
+        if (header.generation != generation)
+            return rewrite(generation, contents.data() + applyFrom, pos - applyFrom);
+
+        // Drop anything after the last intact record so new appends follow it directly
+        return ftruncate(fd, pos) == 0 && lseek(fd, pos, SEEK_SET) == (off_t)pos;
+    }
+
+    bool isOpen() const { return fd != -1; }
+    uint64_t size() const { return recordCount; }
+
+    bool logAdmit(bool emergency, PatientId id, const string &name, const string &disease, const string &severity, const string &doctor, int roomNumber)
+    {
+        string payload(1, (char)(emergency ? JournalOp::AdmitEmergency : JournalOp::Admit));
+        putU32(payload, id);
+        putString(payload, name);
+        putString(payload, disease);
+        putString(payload, severity);
+        putString(payload, doctor);
+        putU32(payload, (uint32_t)roomNumber);
+        return append(payload);
+    }
+
+    bool logDischarge(PatientId id)
+    {
+        string payload(1, (char)JournalOp::Discharge);
+        putU32(payload, id);
+        return append(payload);
+    }
+
+    void sync()
+    {
+        if (fd != -1 && unsynced > 0)
+            fdatasync(fd);
+        unsynced = 0;
+    }
+
+    // Records that a snapshot of `generation` was captured here. Records appended from now
+    // on are the ones it will not contain.
+    bool markCheckpoint(uint64_t generation)
+    {
+        string payload(1, (char)JournalOp::Checkpoint);
+        putU32(payload, 0);
+        putU32(payload, (uint32_t)generation);
+        putU32(payload, (uint32_t)(generation >> 32));
+        if (!append(payload))
+            return false;
+        sync();
+        checkpointEnd = lseek(fd, 0, SEEK_CUR);
+        checkpointRecords = recordCount;
+        return checkpointEnd != (off_t)-1;
+    }
+
+    // Once the snapshot marked by markCheckpoint is on disk, cuts the journal down to the
+    // records appended since. Costs time in proportion to those records only.
+    bool finishCheckpoint(uint64_t generation)
+    {
+        if (fd == -1 || checkpointEnd == -1)
+            return false;
+        sync();
+        off_t end = lseek(fd, 0, SEEK_CUR);
+        string tail(end > checkpointEnd ? (size_t)(end - checkpointEnd) : 0, '\0');
+        for (size_t done = 0; done < tail.size();)
+        {
+            ssize_t n = pread(fd, &tail[done], tail.size() - done, checkpointEnd + (off_t)done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            done += n;
+        }
+        checkpointEnd = -1;
+        if (!rewrite(generation, tail.data(), tail.size()))
+            return false;
+        recordCount -= checkpointRecords;
+        return true;
+    }
+
+    // Forgets a checkpoint whose snapshot could not be written; its record is ignored
+    void abandonCheckpoint() { checkpointEnd = -1; }
+
+    void close()
+    {
+        if (fd == -1)
+            return;
+        sync();
+        ::close(fd);
+        fd = -1;
+    }
+};
+
+// Reads a roster file, one doctor per line: "<name> | <surcharge> | <specialty> | ...".
+// Fields are trimmed and lines starting with '#' are comments. The file is mapped and the
+// roster reserved from its line count before parsing, so a large roster is read without
+// regrowing. On failure `error` names the bad line and `roster` is left as it was.
+bool loadRoster(const string &path, vector<DoctorSpec> &roster, string &error)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        error = "cannot open " + path + " or it is empty";
+        return false;
+    }
+
+    vector<DoctorSpec> doctors;
+    doctors.reserve(count(file.data(), file.data() + file.size(), '\n') + 1);
+    vector<string_view> fields;
+    LineCursor cursor(file.data(), file.data() + file.size());
+    string_view line;
+    while (cursor.next(line))
+    {
+        line = trimField(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        splitFields(line, fields);
+
+        double surcharge = -1;
+        bool valid = fields.size() >= 3 && !fields[0].empty() &&
+                     from_chars(fields[1].data(), fields[1].data() + fields[1].size(), surcharge).ptr == fields[1].data() + fields[1].size() &&
+                     surcharge >= 0;
+        for (size_t i = 2; valid && i < fields.size(); i++)
+            valid = !fields[i].empty();
+        if (!valid)
+        {
+            error = path + ":" + to_string(cursor.line() - 1) + ": expected \"<name> | <surcharge> | <specialty> [| <specialty> ...]\"";
+            return false;
+        }
+
+        doctors.push_back({string(fields[0]), vector<string>(fields.begin() + 2, fields.end()), surcharge});
+    }
+    roster.swap(doctors);
+    return true;
+}
+
+// Reads a ward file: one ward per line, "<name> | <floor> | <type> | <rooms>", then
+// optionally "emergency" for a ward that takes emergency admissions first and the names of
+// the doctors based on the ward, each in its own |-separated field. Fields are trimmed, blank
+// lines and lines starting with # are skipped, and the wards' rooms are numbered in file order.
+bool loadWards(const string &path, vector<WardSpec> &wards, string &error)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        error = "cannot open " + path + " or it is empty";
+        return false;
+    }
+
+    auto number = [](string_view field, int &value)
+    { return from_chars(field.data(), field.data() + field.size(), value).ptr == field.data() + field.size() && !field.empty(); };
+
+    vector<WardSpec> parsed;
+    vector<string_view> fields;
+    long long totalRooms = 0;
+    LineCursor cursor(file.data(), file.data() + file.size());
+    string_view line;
+    while (cursor.next(line))
+    {
+        line = trimField(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        splitFields(line, fields);
+
+        string where = path + ":" + to_string(cursor.line() - 1) + ": ";
+        WardSpec ward;
+        bool valid = fields.size() >= 4 && !fields[0].empty() && number(fields[1], ward.floor) &&
+                     parseRoomType(fields[2], ward.type) && number(fields[3], ward.rooms) && ward.rooms > 0;
+        for (size_t i = 4; valid && i < fields.size(); i++)
+            valid = !fields[i].empty();
+        if (!valid)
+        {
+            error = where + "expected \"<name> | <floor> | general|icu|isolation | <rooms> [| emergency] [| <doctor> ...]\"";
+            return false;
+        }
+        ward.name = string(fields[0]);
+        for (auto &w : parsed)
+        {
+            if (w.name == ward.name)
+            {
+                error = where + "ward " + ward.name + " is listed twice";
+                return false;
+            }
+        }
+        for (size_t i = 4; i < fields.size(); i++)
+        {
+            string lower(fields[i]);
+            for (auto &c : lower)
+                c = (char)tolower((unsigned char)c);
+            if (lower == "emergency")
+                ward.emergency = true;
+            else
+                ward.doctors.emplace_back(fields[i]);
+        }
+        totalRooms += ward.rooms;
+        if (totalRooms > numeric_limits<int>::max() / 2)
+        {
+            error = where + "too many rooms";
+            return false;
+        }
+        parsed.push_back(move(ward));
+    }
+    if (parsed.empty())
+    {
+        error = path + " lists no wards";
+        return false;
+    }
+    wards.swap(parsed);
+    return true;
+}
+
+// Startup and persistence settings for a Hospital
+struct HospitalConfig
+{
+    SnapshotFormat format = SnapshotFormat::Binary;
+    string dataFile = "hospital_data.txt";
+    string snapshotFile = "hospital_data.bin";
+    string journalFile = "hospital_journal.log";
+    bool journaling = true;
+    int groupCommitRecords = 64; // fsync after this many journal records...
+    int groupCommitMillis = 50;  // ...or once the oldest unsynced record is this old
+    int autosaveSeconds = 0;     // background checkpoint of unsaved changes this often; 0 for none
+    string tariffFile;           // custom tariffs applied over the built-in ones; empty for none
+    int roomCount = TOTAL_ROOMS; // rooms in a fresh hospital; a loaded save keeps its own count
+    vector<WardSpec> wards;      // wards of a fresh hospital, overriding roomCount; empty for one ward
+    string wardFile;             // read at startup in place of `wards`; empty for none
+    vector<DoctorSpec> roster;   // replaces the built-in doctors when not empty
+    string rosterFile;           // read at startup in place of `roster`; empty for none
+    double loadWeight = 0;       // Rs. added to a doctor's recommendation score per current patient
+    int doctorCap = 0;           // patients beyond which a doctor is not recommended; 0 for no cap
+    string metricsFile = "hospital_metrics.prom"; // Prometheus text export
+};
+
+// Running totals behind the summary report. Every admission and discharge adjusts them in
+// O(1), so a report costs O(doctors + diseases) regardless of the census size.
+class CensusStats
+{
+private:
+    vector<int> doctorPatients;
+    vector<double> doctorRevenue;
+    vector<int> diseasePatients;  // by DiseaseIndex code
+    vector<int> severityPatients; // by DiseaseIndex severity code
+    int unknownDisease;
+    int unknownSeverity;
+    int patients;
+    int emergencies;
+    double revenue;
+
+    static void bump(vector<int> &counts, int code, int delta)
+    {
+        if (code >= (int)counts.size())
+            counts.resize(code + 1, 0);
+        counts[code] += delta;
+    }
+
+public:
+    CensusStats() { reset(0); }
+
+    void reset(int doctorCount)
+    {
+        doctorPatients.assign(doctorCount, 0);
+        doctorRevenue.assign(doctorCount, 0);
+        diseasePatients.clear();
+        severityPatients.clear();
+        unknownDisease = unknownSeverity = patients = emergencies = 0;
+        revenue = 0;
+    }
+
+    // sign is +1 for an admission and -1 for a discharge of the same patient
+    void apply(int sign, int doctorId, int diseaseCode, int severityCode, bool emergency, double bill)
+    {
+        patients += sign;
+        emergencies += emergency ? sign : 0;
+        revenue += sign * bill;
+
+        if (doctorId >= 0 && doctorId < (int)doctorPatients.size())
+        {
+            doctorPatients[doctorId] += sign;
+            doctorRevenue[doctorId] += sign * bill;
+            if (doctorPatients[doctorId] == 0)
+                doctorRevenue[doctorId] = 0; // drop floating-point residue
+        }
+        if (patients == 0)
+            revenue = 0;
+
+        if (diseaseCode >= 0)
+            bump(diseasePatients, diseaseCode, sign);
+        else
+            unknownDisease += sign;
+        if (severityCode >= 0)
+            bump(severityPatients, severityCode, sign);
+        else
+            unknownSeverity += sign;
+    }
+
+    // Moves one patient's bill from `before` to `after`, e.g. after a tariff change
+    void rebill(int doctorId, double before, double after)
+    {
+        revenue += after - before;
+        if (doctorId >= 0 && doctorId < (int)doctorRevenue.size())
+            doctorRevenue[doctorId] += after - before;
+    }
+
+    int doctorPatientCount(int id) const { return id < (int)doctorPatients.size() ? doctorPatients[id] : 0; }
+    double doctorRevenueOf(int id) const { return id < (int)doctorRevenue.size() ? doctorRevenue[id] : 0; }
+    int diseaseCount(int code) const { return code < (int)diseasePatients.size() ? diseasePatients[code] : 0; }
+    int severityCount(int code) const { return code < (int)severityPatients.size() ? severityPatients[code] : 0; }
+    int unknownDiseaseCount() const { return unknownDisease; }
+    int unknownSeverityCount() const { return unknownSeverity; }
+    int patientCount() const { return patients; }
+    int emergencyCount() const { return emergencies; }
+    double totalRevenue() const { return revenue; }
+
+    // Adds another set of totals to these, e.g. to combine the shards of a census
+    void merge(const CensusStats &other)
+    {
+        auto add = [](vector<int> &into, const vector<int> &from)
+        {
+            if (into.size() < from.size())
+                into.resize(from.size(), 0);
+            for (size_t i = 0; i < from.size(); i++)
+                into[i] += from[i];
+        };
+        add(doctorPatients, other.doctorPatients);
+        add(diseasePatients, other.diseasePatients);
+        add(severityPatients, other.severityPatients);
+        if (doctorRevenue.size() < other.doctorRevenue.size())
+            doctorRevenue.resize(other.doctorRevenue.size(), 0);
+        for (size_t i = 0; i < other.doctorRevenue.size(); i++)
+            doctorRevenue[i] += other.doctorRevenue[i];
+        unknownDisease += other.unknownDisease;
+        unknownSeverity += other.unknownSeverity;
+        patients += other.patients;
+        emergencies += other.emergencies;
+        revenue += other.revenue;
+    }
+};
+
+// Visits several ranges of patients in ascending ID order. IDs only grow, so each range is
+// already in order and this is a k-way merge.
+template <typename Iterator, typename Visit>
+void mergeById(vector<pair<Iterator, Iterator>> ranges, Visit &visit)
+{
+    typedef pair<PatientId, size_t> Head; // next ID, range
+    priority_queue<Head, vector<Head>, greater<Head>> next;
+    for (size_t i = 0; i < ranges.size(); i++)
+        if (ranges[i].first != ranges[i].second)
+            next.push({(*ranges[i].first).getId(), i});
+    while (!next.empty())
+    {
+        size_t i = next.top().second;
+        next.pop();
+        visit(*ranges[i].first);
+        if (++ranges[i].first != ranges[i].second)
+            next.push({(*ranges[i].first).getId(), i});
+    }
+}
+
+// One patient as captured for a CensusSnapshot; the name lives in its chunk's arena
+struct PatientRecord
+{
+    PatientId id;
+    uint32_t nameStart;
+    uint32_t nameLength;
+    uint16_t disease; // PatientStore codes
+    uint16_t severity;
+    int32_t doctorId;
+    int32_t roomNumber;
+    bool emergency;
+};
+
+// Records with their names packed into one arena. Chunks inside a snapshot are sorted by
+// ID, immutable, and shared between snapshot versions.
+struct RecordChunk
+{
+    vector<PatientRecord> records;
+    string names;
+
+    // Appends a copy of `rec` whose name is the rec.nameLength bytes at `name`
+    void append(PatientRecord rec, const char *name)
+    {
+        rec.nameStart = (uint32_t)names.size();
+        names.append(name, rec.nameLength);
+        records.push_back(rec);
+    }
+
+    void append(const RecordChunk &from, size_t i) { append(from.records[i], from.names.data() + from.records[i].nameStart); }
+
+    void append(const Patient &p)
+    {
+        string name = p.getName();
+        PatientRecord rec = {p.getId(), 0, (uint32_t)name.size(), p.getDiseaseCode(), p.getSeverityCode(), p.getDoctorId(), p.getRoomNumber(), p.isEmergency()};
+        append(rec, name.data());
+    }
+
+    size_t size() const { return records.size(); }
+    bool empty() const { return records.empty(); }
+
+    void clear()
+    {
+        records.clear();
+        names.clear();
+    }
+};
+
+// Patients are spread over this many independently locked shards by ID
+const int PATIENT_SHARDS = 16;
+
+// The census split into PATIENT_SHARDS shards by patient ID. Each shard is a PatientStore
+// with its own emergency index, running totals and lock, so admissions and discharges of
+// different patients rarely wait on each other; whole-census passes lock the shards in turn
+// or, for a consistent view, all at once in index order. All shards intern names into the
+// first shard's code tables, so codes agree across the census.
+class PatientCensus
+{
+public:
+    struct Shard
+    {
+        mutable mutex lock; // guards every member but version
+        PatientStore store;
+        EmergencyIndex emergencies;
+        CensusStats stats;
+        PatientIndex index; // for queries
+
+        // Changes since the last CensusSnapshot cut, which drains them. A log that would
+        // outgrow the shard is dropped instead, and the next cut copies the whole shard.
+        mutable RecordChunk admittedLog;
+        mutable vector<PatientId> dischargedLog;
+        mutable bool logOverflowed; // starts set: the first cut copies the shard
+        atomic<uint64_t> version;   // bumped on every change, so readers can spot a stale snapshot
+
+        explicit Shard(const DoctorRegistry *registry) : store(registry), emergencies(&store), logOverflowed(true), version(0) {}
+
+        void logAdmit(const Patient &p)
+        {
+            version++;
+            if (logOverflowed)
+                return;
+            admittedLog.append(p);
+            trimLog();
+        }
+
+        void logDischarge(PatientId id)
+        {
+            version++;
+            if (logOverflowed)
+                return;
+            dischargedLog.push_back(id);
+            trimLog();
+        }
+
+        // Forgets the log after a wholesale change such as a load
+        void resetLog()
+        {
+            version++;
+            RecordChunk().records.swap(admittedLog.records);
+            string().swap(admittedLog.names);
+            vector<PatientId>().swap(dischargedLog);
+            logOverflowed = true;
+        }
+
+    private:
+        void trimLog()
+        {
+            if (admittedLog.size() + dischargedLog.size() > max<size_t>(4096, 2 * store.size()))
+                resetLog();
+        }
+    };
+
+private:
+    vector<unique_ptr<Shard>> shards;
+    atomic<PatientId> nextId;
+    atomic<int> live;
+    atomic<int> emergencyLive;
+
+public:
+    explicit PatientCensus(const DoctorRegistry *registry) : nextId(1), live(0), emergencyLive(0)
+    {
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            shards.emplace_back(new Shard(registry));
+            if (i > 0)
+                shards[i]->store.shareCodes(shards[0]->store);
+        }
+    }
+
+    Shard &shardFor(PatientId id) { return *shards[id % PATIENT_SHARDS]; }
+    const Shard &shardFor(PatientId id) const { return *shards[id % PATIENT_SHARDS]; }
+    Shard &shard(int i) { return *shards[i]; }
+    const Shard &shard(int i) const { return *shards[i]; }
+
+    // Hands out a fresh, never-used patient ID
+    PatientId claimId() { return nextId.fetch_add(1); }
+
+    // Keeps IDs below `id` from being handed out, e.g. after loading saved patients
+    void reserveIdsBelow(PatientId id)
+    {
+        PatientId current = nextId.load();
+        while (current < id && !nextId.compare_exchange_weak(current, id))
+            ;
+    }
+
+    PatientId peekNextId() const { return nextId.load(); }
+
+    // Called with the patient's shard locked, after adding (+1) or removing (-1) a patient
+    void count(int sign, bool emergency)
+    {
+        live.fetch_add(sign);
+        if (emergency)
+            emergencyLive.fetch_add(sign);
+    }
+
+    size_t size() const { return (size_t)live.load(); }
+    bool empty() const { return live.load() == 0; }
+    size_t emergencyCount() const { return (size_t)emergencyLive.load(); }
+
+    // Locks every shard in index order, for passes that need the whole census to hold still
+    vector<unique_lock<mutex>> lockAll() const
+    {
+        vector<unique_lock<mutex>> locks;
+        for (auto &s : shards)
+            locks.emplace_back(s->lock);
+        return locks;
+    }
+
+    // Drops every patient and restarts numbering at 1. Not safe against concurrent use.
+    void clear(int doctorCount)
+    {
+        for (auto &s : shards)
+        {
+            s->store.clear();
+            s->emergencies.clear();
+            s->stats.reset(doctorCount);
+            s->index.clear();
+            s->resetLog();
+        }
+        nextId = 1;
+        live = 0;
+        emergencyLive = 0;
+    }
+
+    void reserve(size_t patients, size_t nameBytes)
+    {
+        for (auto &s : shards)
+            s->store.reserve(patients / PATIENT_SHARDS + 1, nameBytes / PATIENT_SHARDS + 1);
+    }
+
+    void seedCodes(const vector<string> &diseaseNames, const vector<string> &severityNames)
+    {
+        shards[0]->store.seedCodes(diseaseNames, severityNames);
+    }
+
+    const CodeTable &diseaseTable() const { return shards[0]->store.diseaseTable(); }
+    const CodeTable &severityTable() const { return shards[0]->store.severityTable(); }
+
+    // Visits every patient, or only the emergency ones, in ID order. The caller must keep
+    // the census still, by holding lockAll() or by excluding every other thread.
+    template <typename Visit>
+    void forEach(Visit visit, bool emergencyOnly = false) const
+    {
+        if (emergencyOnly)
+        {
+            typedef decltype(shards[0]->emergencies.begin()) Iterator;
+            vector<pair<Iterator, Iterator>> ranges;
+            for (auto &s : shards)
+                ranges.push_back({s->emergencies.begin(), s->emergencies.end()});
+            mergeById(ranges, visit);
+        }
+        else
+        {
+            typedef decltype(shards[0]->store.begin()) Iterator;
+            vector<pair<Iterator, Iterator>> ranges;
+            for (auto &s : shards)
+                ranges.push_back({s->store.begin(), s->store.end()});
+            mergeById(ranges, visit);
+        }
+    }
+
+};
+
+// ---- Operation metrics ----
+// Counters and latency histograms for the hot Hospital operations. Each thread records into its
+// own shard without locking and readers merge the shards. Build with -DHOSPITAL_NO_METRICS to
+// compile the instrumentation out entirely.
+#ifndef HOSPITAL_NO_METRICS
+
+enum class MetricOp
+{
+    Admit,
+    Recommend,
+    FindRoom,
+    Discharge,
+    Bill,
+    BillAll,
+    Report,
+    Save,
+    Capture,
+    Load,
+    Query,
+    Reload,
+    Count
+};
+
+const char *metricName(MetricOp op)
+{
+    static const char *const names[] = {"admit", "recommend", "find_room", "discharge", "bill", "bill_all", "report", "save", "capture", "load", "query", "tariff_reload"};
+    return names[(int)op];
+}
+
+// Latency buckets are powers of two from 128 ns up to about 1 s, plus one overflow bucket
+const int METRIC_BUCKETS = 24;
+const int METRIC_FIRST_BUCKET_LOG2 = 7;
+
+struct MetricTotals
+{
+    uint64_t count = 0;
+    uint64_t failures = 0;
+    uint64_t totalNs = 0;
+    uint64_t buckets[METRIC_BUCKETS + 1] = {}; // not cumulative; the last one is the overflow
+};
+
+class Metrics
+{
+private:
+    struct Counters
+    {
+        atomic<uint64_t> count{0};
+        atomic<uint64_t> failures{0};
+        atomic<uint64_t> totalNs{0};
+        atomic<uint64_t> buckets[METRIC_BUCKETS + 1]{};
+    };
+
+    // One per recording thread. Only the owner writes, so it can use relaxed load-add-store
+    // instead of locked read-modify-writes; readers may see a shard a few updates behind.
+    struct Shard
+    {
+        Counters ops[(int)MetricOp::Count];
+        Shard() { Metrics::instance().attach(this); }
+        ~Shard() { Metrics::instance().detach(this); }
+    };
+
+    mutex lock;
+    vector<Shard *> shards;
+    MetricTotals retired[(int)MetricOp::Count]; // merged from threads that have exited
+
+    static void bump(atomic<uint64_t> &counter, uint64_t by)
+    {
+        counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+    static void mergeInto(MetricTotals &totals, const Counters &c)
+    {
+        totals.count += c.count.load(memory_order_relaxed);
+        totals.failures += c.failures.load(memory_order_relaxed);
+        totals.totalNs += c.totalNs.load(memory_order_relaxed);
+        for (int b = 0; b <= METRIC_BUCKETS; b++)
+            totals.buckets[b] += c.buckets[b].load(memory_order_relaxed);
+    }
+
+    void attach(Shard *shard)
+    {
+        lock_guard<mutex> guard(lock);
+        shards.push_back(shard);
+    }
+
+    void detach(Shard *shard)
+    {
+        lock_guard<mutex> guard(lock);
+        for (int op = 0; op < (int)MetricOp::Count; op++)
+            mergeInto(retired[op], shard->ops[op]);
+        shards.erase(find(shards.begin(), shards.end(), shard));
+    }
+
+public:
+    static Metrics &instance()
+    {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    // Index of the smallest bucket whose bound 2^(i + METRIC_FIRST_BUCKET_LOG2) ns holds ns
+    static int bucketOf(uint64_t ns)
+    {
+        int log2 = ns <= 1 ? 0 : 64 - __builtin_clzll(ns - 1);
+        return min(METRIC_BUCKETS, max(0, log2 - METRIC_FIRST_BUCKET_LOG2));
+    }
+
+    static double bucketBoundSeconds(int bucket)
+    {
+        return ldexp(1.0, bucket + METRIC_FIRST_BUCKET_LOG2) / 1e9;
+    }
+
+    void record(MetricOp op, uint64_t ns, bool failed)
+    {
+        thread_local Shard shard;
+        Counters &c = shard.ops[(int)op];
+        bump(c.count, 1);
+        bump(c.totalNs, ns);
+        bump(c.buckets[bucketOf(ns)], 1);
+        if (failed)
+            bump(c.failures, 1);
+    }
+
+    // Totals by MetricOp across live and exited threads
+    vector<MetricTotals> totals()
+    {
+        lock_guard<mutex> guard(lock);
+        vector<MetricTotals> merged(retired, retired + (int)MetricOp::Count);
+        for (Shard *shard : shards)
+            for (int op = 0; op < (int)MetricOp::Count; op++)
+                mergeInto(merged[op], shard->ops[op]);
+        return merged;
+    }
+};
+
+// Times the enclosing scope and records it under one operation
+class MetricScope
+{
+private:
+    MetricOp op;
+    chrono::steady_clock::time_point start;
+    bool failed;
+
+public:
+    explicit MetricScope(MetricOp o) : op(o), start(chrono::steady_clock::now()), failed(false) {}
+    ~MetricScope()
+    {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        Metrics::instance().record(op, (uint64_t)ns, failed);
+    }
+    void fail() { failed = true; }
+};
+
+#define HOSPITAL_METRIC(op) MetricScope metricScope(MetricOp::op)
+#define HOSPITAL_METRIC_FAIL() metricScope.fail()
+
+#else
+
+#define HOSPITAL_METRIC(op) ((void)0)
+#define HOSPITAL_METRIC_FAIL() ((void)0)
+
+#endif
+
+// Results returned by the programmatic Hospital API
+enum class AdmitStatus
+{
+    Admitted,
+    InvalidName,
+    UnknownDisease,
+    InvalidSeverity,
+    UnknownDoctor,
+    NoRoom,
+    DoctorsFull
+};
+
+const char *describe(AdmitStatus status)
+{
+    switch (status)
+    {
+    case AdmitStatus::Admitted:
+        return "admitted";
+    case AdmitStatus::InvalidName:
+        return "invalid name";
+    case AdmitStatus::UnknownDisease:
+        return "no doctor treats this disease";
+    case AdmitStatus::InvalidSeverity:
+        return "severity has no tariff";
+    case AdmitStatus::UnknownDoctor:
+        return "doctor not found";
+    case AdmitStatus::NoRoom:
+        return "no rooms available";
+    case AdmitStatus::DoctorsFull:
+        return "every doctor for this disease is at capacity";
+    }
+    return "unknown";
+}
+
+struct Admission
+{
+    AdmitStatus status;
+    PatientId id;   // valid when admitted
+    int doctorId;   // assigned doctor, valid when admitted
+    int roomNumber; // 1-based, valid when admitted
+};
+
+// Filters for Hospital::queryPatients. Every filter given must match; empty strings and a
+// zero room bound match anything.
+struct PatientQuery
+{
+    string disease;
+    string severity;
+    string doctor;
+    string namePrefix; // case-sensitive
+    int firstRoom = 0;  // room numbers, inclusive
+    int lastRoom = 0;
+    int emergency = -1; // 1 for emergency patients only, 0 for the others, -1 for both
+};
+
+struct PatientInfo
+{
+    PatientId id;
+    string name;
+    string disease;
+    string severity;
+    string doctor;
+    int roomNumber;
+    bool emergency;
+
+    void display() const
+    {
+        cout << (emergency ? "Emergency Patient: " : "Patient: ") << name << ", Disease: " << disease
+             << ", Doctor: " << doctor << ", Severity: " << severity << ", Room: " << roomNumber << "\n";
+    }
+};
+
+// One page of query results in ID order. Passing `cursor` back continues after the last
+// patient on this page; it is 0 when there are no more matches.
+struct PatientPage
+{
+    vector<PatientInfo> patients;
+    PatientId cursor = 0;
+};
+
+struct Bill
+{
+    string patientName;
+    string disease;
+    string severity;
+    string doctor;
+    int roomNumber;
+    bool emergency;
+    double cost;
+};
+
+// What a tariff reload changed
+struct TariffReload
+{
+    int diseases = 0;        // diseases whose cost changed
+    int severities = 0;      // severities whose multiplier changed
+    int doctors = 0;         // doctors whose surcharge changed
+    bool emergency = false;  // the emergency factor changed
+    size_t checked = 0;      // patients looked at
+    size_t rebilled = 0;     // patients whose bill changed
+};
+
+struct DoctorSummary
+{
+    string name;
+    int patients;
+    double revenue;
+};
+
+struct Summary
+{
+    vector<DoctorSummary> doctors;
+    double totalRevenue;
+    int patients;
+    int emergencies;
+    vector<pair<string, int>> byDisease;  // diseases with at least one patient
+    vector<pair<string, int>> bySeverity; // severities with at least one patient
+};
+
+// Immutable, consistent view of the census as of one instant, from Hospital::snapshot().
+// Readers hold no lock while they use it and may keep it as long as they like. Patients are
+// kept per shard as ID-ordered chunks; a new version shares every shard and every chunk that
+// did not change since the previous one, so publishing costs about the size of the changes.
+class CensusSnapshot
+{
+public:
+    static const size_t CHUNK = 64; // records per chunk after a split; rebuilding one costs ~1 us
+
+    struct ShardView
+    {
+        vector<shared_ptr<const RecordChunk>> chunks; // ascending IDs across all chunks
+        size_t size = 0;
+    };
+    typedef shared_ptr<const vector<string>> Names;
+
+    // One patient of the snapshot, with the same getters as Patient
+    class Entry
+    {
+    private:
+        const CensusSnapshot *snapshot;
+        const RecordChunk *chunk;
+        uint32_t index;
+
+        const PatientRecord &record() const { return chunk->records[index]; }
+
+    public:
+        Entry(const CensusSnapshot *s, const RecordChunk *c, uint32_t i) : snapshot(s), chunk(c), index(i) {}
+
+        PatientId getId() const { return record().id; }
+        string getName() const { return chunk->names.substr(record().nameStart, record().nameLength); }
+        const string &getDisease() const { return nameIn(*snapshot->diseaseNames, record().disease); }
+        const string &getSeverity() const { return nameIn(*snapshot->severityNames, record().severity); }
+        int getDoctorId() const { return record().doctorId; }
+        const string &getAssignedDoctor() const { return nameIn(*snapshot->doctorNames, record().doctorId, true); }
+        int getRoomNumber() const { return record().roomNumber; }
+        bool isEmergency() const { return record().emergency; }
+
+        void display() const
+        {
+            cout << (isEmergency() ? "Emergency Patient: " : "Patient: ") << getName() << ", Disease: " << getDisease()
+                 << ", Doctor: " << getAssignedDoctor() << ", Severity: " << getSeverity() << ", Room: " << getRoomNumber() << "\n";
+        }
+
+        // Same text record as Patient::save
+        void save(ostream &out) const
+        {
+            out << (isEmergency() ? "EMERGENCY" : "PATIENT") << " " << getId() << "\n";
+            out << getName() << "\n";
+            out << getDisease() << "\n";
+            out << getAssignedDoctor() << "\n";
+            out << getSeverity() << "\n";
+            out << getRoomNumber() << "\n";
+        }
+    };
+
+private:
+    vector<shared_ptr<const ShardView>> shards;
+    vector<uint64_t> versions; // of each census shard at the cut
+    Names diseaseNames;
+    Names severityNames;
+    Names doctorNames;
+    Summary summary;
+    int roomCount;
+
+    // Same fallbacks as CodeTable and DoctorRegistry for codes and IDs they never handed out
+    static const string &nameIn(const vector<string> &names, int index, bool doctor = false)
+    {
+        static const string unknown = "Unknown";
+        static const string none;
+        if (index >= 0 && index < (int)names.size())
+            return names[index];
+        return doctor ? none : unknown;
+    }
+
+    // Walks one shard's records in ID order
+    class ShardIterator
+    {
+    private:
+        const CensusSnapshot *snapshot;
+        const ShardView *view;
+        size_t chunk;
+        uint32_t index;
+        bool emergencyOnly;
+
+        void settle()
+        {
+            while (chunk < view->chunks.size())
+            {
+                const RecordChunk &c = *view->chunks[chunk];
+                while (index < c.size() && emergencyOnly && !c.records[index].emergency)
+                    index++;
+                if (index < c.size())
+                    return;
+                chunk++;
+                index = 0;
+            }
+        }
+
+    public:
+        ShardIterator(const CensusSnapshot *s, const ShardView *v, size_t c, bool emergency) : snapshot(s), view(v), chunk(c), index(0), emergencyOnly(emergency) { settle(); }
+
+        Entry operator*() const { return Entry(snapshot, view->chunks[chunk].get(), index); }
+        ShardIterator &operator++()
+        {
+            index++;
+            settle();
+            return *this;
+        }
+        bool operator!=(const ShardIterator &other) const { return chunk != other.chunk || index != other.index; }
+    };
+
+    // Cuts a sorted chunk into CHUNK-sized pieces unless it is small enough to keep whole,
+    // in which case it is moved from
+    static void split(RecordChunk &all, vector<shared_ptr<const RecordChunk>> &out)
+    {
+        if (all.empty())
+            return;
+        if (all.size() < 2 * CHUNK)
+        {
+            out.push_back(make_shared<const RecordChunk>(move(all)));
+            return;
+        }
+        for (size_t start = 0; start < all.size(); start += CHUNK)
+        {
+            auto piece = make_shared<RecordChunk>();
+            size_t end = min(all.size(), start + CHUNK);
+            for (size_t i = start; i < end; i++)
+                piece->append(all, i);
+            out.push_back(piece);
+        }
+    }
+
+public:
+    CensusSnapshot(vector<shared_ptr<const ShardView>> shardViews, vector<uint64_t> shardVersions, Names diseases, Names severities, Names doctorList,
+                   Summary report, int rooms)
+        : shards(move(shardViews)), versions(move(shardVersions)), diseaseNames(move(diseases)), severityNames(move(severities)),
+          doctorNames(move(doctorList)), summary(move(report)), roomCount(rooms)
+    {
+    }
+
+    const Summary &report() const { return summary; }
+    size_t size() const { return summary.patients; }
+    size_t emergencyCount() const { return summary.emergencies; }
+    int rooms() const { return roomCount; }
+    int roomsFree() const { return roomCount - summary.patients; } // every patient holds one room
+
+    uint64_t shardVersion(int i) const { return versions[i]; }
+    const shared_ptr<const ShardView> &shard(int i) const { return shards[i]; }
+    const Names &diseaseTable() const { return diseaseNames; }
+    const Names &severityTable() const { return severityNames; }
+    const Names &doctorTable() const { return doctorNames; }
+
+    // Calls visit(const Entry &) for every patient, or only the emergency ones, in ID order
+    template <typename Visit>
+    void forEach(Visit visit, bool emergencyOnly = false) const
+    {
+        vector<pair<ShardIterator, ShardIterator>> ranges;
+        for (auto &s : shards)
+            ranges.push_back({ShardIterator(this, s.get(), 0, emergencyOnly), ShardIterator(this, s.get(), s->chunks.size(), emergencyOnly)});
+        auto visitEntry = [&visit](const Entry &e)
+        { visit(e); };
+        mergeById(ranges, visitEntry);
+    }
+
+    // Builds a shard from a full copy of its records, in any order
+    static shared_ptr<const ShardView> build(RecordChunk &all)
+    {
+        sort(all.records.begin(), all.records.end(), [](const PatientRecord &a, const PatientRecord &b)
+             { return a.id < b.id; });
+        auto view = make_shared<ShardView>();
+        RecordChunk sorted; // the arena in ID order, so that pieces copy names sequentially
+        sorted.records.reserve(all.size());
+        sorted.names.reserve(all.names.size());
+        for (size_t i = 0; i < all.size(); i++)
+            sorted.append(all, i);
+        view->size = sorted.size();
+        split(sorted, view->chunks);
+        return view;
+    }
+
+    // Applies one cut's admissions and discharges to the previous version of a shard.
+    // Only chunks whose ID range was touched are rebuilt; the rest are shared.
+    static shared_ptr<const ShardView> apply(const ShardView &old, const RecordChunk &admitted, vector<PatientId> &discharged)
+    {
+        sort(discharged.begin(), discharged.end());
+        vector<uint32_t> order(admitted.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        sort(order.begin(), order.end(), [&admitted](uint32_t a, uint32_t b)
+             { return admitted.records[a].id < admitted.records[b].id; });
+
+        // A patient both admitted and discharged since the last cut never shows up
+        vector<uint32_t> adds;
+        vector<PatientId> admittedIds;
+        for (uint32_t i : order)
+        {
+            admittedIds.push_back(admitted.records[i].id);
+            if (!binary_search(discharged.begin(), discharged.end(), admitted.records[i].id))
+                adds.push_back(i);
+        }
+        vector<PatientId> drops;
+        set_difference(discharged.begin(), discharged.end(), admittedIds.begin(), admittedIds.end(), back_inserter(drops));
+
+        auto view = make_shared<ShardView>();
+        size_t a = 0, d = 0;
+        for (size_t c = 0; c < old.chunks.size(); c++)
+        {
+            const RecordChunk &chunk = *old.chunks[c];
+            // Admissions past the last chunk's end go into the last chunk
+            PatientId bound = c + 1 == old.chunks.size() ? numeric_limits<PatientId>::max() : chunk.records.back().id;
+            size_t aEnd = a, dEnd = d;
+            while (aEnd < adds.size() && admitted.records[adds[aEnd]].id <= bound)
+                aEnd++;
+            while (dEnd < drops.size() && drops[dEnd] <= bound)
+                dEnd++;
+            if (a == aEnd && d == dEnd)
+            {
+                view->chunks.push_back(old.chunks[c]);
+                view->size += chunk.size();
+                continue;
+            }
+
+            RecordChunk merged;
+            size_t r = 0;
+            while (r < chunk.size() || a < aEnd)
+            {
+                if (r == chunk.size() || (a < aEnd && admitted.records[adds[a]].id < chunk.records[r].id))
+                {
+                    merged.append(admitted, adds[a++]);
+                    continue;
+                }
+                PatientId id = chunk.records[r].id;
+                while (d < dEnd && drops[d] < id)
+                    d++;
+                if (d < dEnd && drops[d] == id)
+                    d++;
+                else
+                    merged.append(chunk, r);
+                r++;
+            }
+            d = dEnd;
+            view->size += merged.size();
+            split(merged, view->chunks);
+        }
+        if (old.chunks.empty())
+        {
+            RecordChunk fresh;
+            for (; a < adds.size(); a++)
+                fresh.append(admitted, adds[a]);
+            view->size += fresh.size();
+            split(fresh, view->chunks);
+        }
+
+        // Discharges leave small chunks behind; repack once they dominate
+        if (view->chunks.size() > 4 + 2 * view->size / CHUNK)
+        {
+            RecordChunk all;
+            for (auto &chunk : view->chunks)
+                for (size_t i = 0; i < chunk->size(); i++)
+                    all.append(*chunk, i);
+            view->chunks.clear();
+            split(all, view->chunks);
+        }
+        return view;
+    }
+};
+
+// Everything a save file holds, captured from a Hospital at one instant. The patients are a
+// CensusSnapshot sharing its chunks with the live one, so capturing costs about the changes
+// since the previous snapshot, and the copy can be written out while admissions go on.
+struct Checkpoint
+{
+    uint64_t generation = 0;
+    PatientId nextPatientId = 0;
+    vector<DoctorSpec> doctors;
+    vector<int> doctorPatients;
+    shared_ptr<const CensusSnapshot> census;
+    vector<uint64_t> roomWords; // occupancy bitmap
+    int roomCount = 0;
+    shared_ptr<const WardTopology> wards;
+    bool marked = false; // the journal holds a checkpoint record waiting for this one
+};
+
+// Hospital class
+//
+// Safe for concurrent use. Per-patient operations (admit, discharge, bill) hold stateLock
+// shared and lock only the patient's census shard; rooms are claimed lock-free and doctor
+// counts are atomic. Whole-hospital operations (load, import, verify) hold stateLock
+// exclusively, and saves only long enough to capture a Checkpoint, which is written after
+// the lock is dropped, by a background writer thread if asked to. Reports and listings read
+// a published CensusSnapshot instead of the live census. Doctors and the disease index are
+// fixed once constructed. The tariff table, the doctors' surcharges, the recommender and
+// the wards change only under an exclusive stateLock: tariffs grow during loads and are
+// replaced by a tariff reload, and the wards are replaced by loads. Private helpers expect
+// the caller to hold stateLock.
+class Hospital
+{
+private:
+    DoctorRegistry doctors;
+    DiseaseIndex diseaseIndex;
+    DoctorRecommender recommender;
+    RoomAllocator rooms; // zone w is ward w of `wards`
+    shared_ptr<const WardTopology> wards;
+    shared_ptr<const WardTopology> freshWards; // the configured wards, for a hospital without a save
+    vector<int> doctorWard;                    // home ward by doctor ID, -1 for none
+    RoomOccupants occupants; // patient per room, for queries
+    PatientCensus census; // patients and their running totals, sharded by ID
+    TariffSchedule tariffSchedule;
+    TariffTable tariffs; // tariffSchedule by PatientStore code
+    vector<double> rosterSurcharges; // by doctor ID, before tariff overrides
+    HospitalConfig config;
+    uint64_t generation; // of the last snapshot written or loaded
+    Journal journal;
+    mutable shared_mutex stateLock;
+    mutex journalLock; // guards journal; lock order is snapshotLock, stateLock, journalLock, then shard locks
+    mutable mutex snapshotLock; // serializes snapshot builders; never taken under stateLock
+    mutable shared_ptr<const CensusSnapshot> published; // latest snapshot; atomic_load/atomic_store only
+    mutex checkpointLock; // one checkpoint, load or import at a time; taken before snapshotLock
+    vector<uint64_t> savedVersions; // census shard versions as of the last checkpoint written
+
+    // Background checkpoint writer, started on the first request or by autosave
+    mutex writerLock;
+    condition_variable writerWake;
+    thread writer;
+    bool writerRequested = false;
+    bool writerBusy = false;
+    bool writerStopping = false;
+
+    // Gives every doctor the tariff's surcharge for them, or else the roster's
+    void applySurcharges()
+    {
+        for (int id = 0; id < doctors.size(); id++)
+        {
+            auto it = tariffSchedule.surcharges.empty() ? tariffSchedule.surcharges.end() : tariffSchedule.surcharges.find(doctors.get(id)->getName());
+            doctors.get(id)->setSurcharge(it == tariffSchedule.surcharges.end() ? rosterSurcharges[id] : it->second);
+        }
+    }
+
+    void initializeDoctors(vector<DoctorSpec> roster)
+    {
+        static const vector<DoctorSpec> builtinRoster = {
+            {"Dr. Smith", {"Flu", "Cold"}, 800},
+            {"Dr. Jones", {"Diabetes", "Hypertension"}, 1500},
+            {"Dr. Brown", {"Asthma", "Allergy"}, 1200},
+            {"Dr. Taylor", {"Fever", "Flu"}, 900},
+            {"Dr. Wilson", {"Cold", "Migraine"}, 700},
+            {"Dr. Moore", {"Diabetes", "Obesity"}, 2000},
+            {"Dr. Clark", {"Hypertension", "Heart Disease"}, 2500},
+            {"Dr. Lewis", {"Allergy", "Skin Infection"}, 800},
+            {"Dr. Hall", {"Asthma", "Pneumonia"}, 1800},
+            {"Dr. Allen", {"Fever", "Infection"}, 1000},
+        };
+
+        // Fresh doctors, from the given roster or the built-in one, indexed in bulk
+        doctors.assign(roster.empty() ? builtinRoster : move(roster));
+        diseaseIndex.build(doctors);
+        rosterSurcharges.resize(doctors.size());
+        for (int id = 0; id < doctors.size(); id++)
+            rosterSurcharges[id] = doctors.surchargeOf(id);
+
+        applySurcharges();
+        diseaseIndex.rebuildSeverities(tariffSchedule);
+        census.clear(doctors.size());
+        recommender.rebuild(diseaseIndex, doctors, tariffSchedule);
+        tariffs.emergencyFactor = tariffSchedule.emergencyFactor;
+
+        // Store codes match DiseaseIndex codes, so reports can use them directly
+        census.seedCodes(diseaseIndex.all(), diseaseIndex.allSeverities());
+        syncTariffs();
+    }
+
+    // Extends the tariff arrays to cover codes the store has handed out since the last call.
+    // Admissions only use seeded codes, so this only writes during (exclusive) loads.
+    void syncTariffs()
+    {
+        const CodeTable &diseaseNames = census.diseaseTable();
+        for (size_t code = tariffs.diseaseCost.size(); code < diseaseNames.size(); code++)
+            tariffs.diseaseCost.push_back(tariffSchedule.diseaseCost.valueOf(diseaseNames.nameOf((uint16_t)code)));
+        const CodeTable &severityNames = census.severityTable();
+        for (size_t code = tariffs.severityMultiplier.size(); code < severityNames.size(); code++)
+            tariffs.severityMultiplier.push_back(tariffSchedule.severityMultiplier.valueOf(severityNames.nameOf((uint16_t)code)));
+    }
+
+    // Adds or removes one patient's contribution to the doctor counts and its shard's report
+    // totals; the shard must be locked
+    void account(PatientCensus::Shard &shard, const Patient &p, int sign)
+    {
+        int diseaseCode = p.getDiseaseCode() < diseaseIndex.size() ? p.getDiseaseCode() : -1;
+        int severityCode = p.getSeverityCode() < diseaseIndex.allSeverities().size() ? p.getSeverityCode() : -1;
+        doctors.adjustPatientCount(p.getDoctorId(), sign);
+        recommender.adjust(p.getDoctorId(), sign);
+        shard.stats.apply(sign, p.getDoctorId(), diseaseCode, severityCode, p.isEmergency(), p.getCachedBill());
+        census.count(sign, p.isEmergency());
+    }
+
+    // Core admission shared by the interactive flows, the loaders and journal replay: stores
+    // the patient and updates the emergency index and running totals. The room must already
+    // be reserved. Returns the patient's ID, which is `id` unless that is 0 or taken.
+    PatientId addPatientRecord(bool emergency, string_view name, string_view disease, int doctorId, string_view severity, int roomNumber, PatientId id = 0)
+    {
+        if (id == 0 || containsPatient(id))
+            id = census.claimId();
+        else
+            census.reserveIdsBelow(id + 1);
+
+        PatientCensus::Shard &shard = census.shardFor(id);
+        lock_guard<mutex> guard(shard.lock);
+        shard.store.add(id, emergency, name, disease, severity, doctorId, roomNumber);
+        syncTariffs();
+        if (emergency)
+            shard.emergencies.insert(id);
+        Patient p = shard.store.find(id);
+        shard.store.setBill(shard.store.rowFor(id), p.calculateBill(tariffs, getDoctorSurcharge(doctorId)));
+        account(shard, p, +1);
+        shard.index.add(p);
+        occupants.set(roomNumber, id);
+        shard.logAdmit(p);
+        return id;
+    }
+
+    bool containsPatient(PatientId id) const
+    {
+        const PatientCensus::Shard &shard = census.shardFor(id);
+        lock_guard<mutex> guard(shard.lock);
+        return shard.store.rowFor(id) != PatientStore::NO_ROW;
+    }
+
+    // Removes the patient and returns the index of the room they held, or -1 if there is
+    // no such patient. The room stays occupied until the caller releases it, so that a
+    // discharge is journaled before anyone else can be journaled into the same room.
+    int applyDischarge(PatientId id)
+    {
+        PatientCensus::Shard &shard = census.shardFor(id);
+        lock_guard<mutex> guard(shard.lock);
+        Patient p = shard.store.find(id);
+        if (!p)
+            return -1;
+        if (p.isEmergency())
+            shard.emergencies.remove(id);
+        account(shard, p, -1);
+        shard.index.remove(p);
+        occupants.clear(p.getRoomNumber(), id);
+        int room = p.getRoomNumber() - 1;
+        shard.store.remove(id);
+        shard.logDischarge(id);
+        return room;
+    }
+
+    void journalAdmit(PatientId id)
+    {
+        lock_guard<mutex> guard(journalLock);
+        if (!journal.isOpen())
+            return;
+        PatientCensus::Shard &shard = census.shardFor(id);
+        lock_guard<mutex> shardGuard(shard.lock);
+        Patient p = shard.store.find(id);
+        if (p)
+            journal.logAdmit(p.isEmergency(), p.getId(), p.getName(), p.getDisease(), p.getSeverity(), p.getAssignedDoctor(), p.getRoomNumber());
+    }
+
+    void journalDischarge(PatientId id)
+    {
+        lock_guard<mutex> guard(journalLock);
+        if (journal.isOpen())
+            journal.logDischarge(id);
+    }
+
+    bool journalNeedsCompaction()
+    {
+        lock_guard<mutex> guard(journalLock);
+        return journal.isOpen() && journal.size() >= max<uint64_t>(1024, census.size());
+    }
+
+    // Folds the journal into a fresh snapshot once it holds more records than the census,
+    // so replay time and journal size stay proportional to recent activity. The snapshot is
+    // written by the background writer. Called with no lock held, after an admission or
+    // discharge.
+    void compactIfNeeded()
+    {
+        if (!journalNeedsCompaction())
+            return;
+        lock_guard<mutex> guard(writerLock);
+        if (!writerBusy && !writerRequested)
+            wakeWriter();
+    }
+
+    // Loaded patients whose doctor is not on the roster are kept but left unassigned, and the
+    // next save no longer names the doctor; says so once per doctor
+    static void warnUnknownDoctors(const string &source, const map<string, size_t> &unknown)
+    {
+        for (auto &d : unknown)
+            cout << "Warning: " << source << ": " << d.first << " is not on the roster; " << d.second << " patient(s) left unassigned.\n";
+    }
+
+    void replayJournal(const vector<JournalEntry> &entries)
+    {
+        map<string, size_t> unknownDoctors;
+        for (auto &e : entries)
+        {
+            if (e.op == JournalOp::Discharge)
+            {
+                rooms.release(applyDischarge(e.patientId));
+            }
+            else
+            {
+                int doctorId = doctors.findId(e.doctor);
+                if (doctorId == -1 && !e.doctor.empty())
+                    unknownDoctors[e.doctor]++;
+                rooms.reserve(e.roomNumber - 1);
+                addPatientRecord(e.op == JournalOp::AdmitEmergency, e.name, e.disease, doctorId, e.severity, e.roomNumber, e.patientId);
+            }
+        }
+        warnUnknownDoctors(config.journalFile, unknownDoctors);
+    }
+
+    // Claims a room for a new patient of `doctorId`, see WardTopology::place
+    int allocateRoom(bool emergency, int doctorId)
+    {
+        HOSPITAL_METRIC(FindRoom);
+        int home = doctorId >= 0 && doctorId < (int)doctorWard.size() ? doctorWard[doctorId] : -1;
+        int roomIndex = wards->place(rooms, emergency, home);
+        if (roomIndex == -1)
+            HOSPITAL_METRIC_FAIL();
+        return roomIndex;
+    }
+
+    // Validates and admits a patient; doctorId -1 means the recommended doctor
+    Admission admit(bool emergency, const string &name, const string &disease, const string &severity, int doctorId)
+    {
+        HOSPITAL_METRIC(Admit);
+        auto reject = [&](AdmitStatus status) -> Admission
+        {
+            HOSPITAL_METRIC_FAIL();
+            return {status, 0, -1, 0};
+        };
+        if (name.empty())
+            return reject(AdmitStatus::InvalidName);
+        if (diseaseIndex.codeOf(disease) == -1)
+            return reject(AdmitStatus::UnknownDisease);
+        if (diseaseIndex.severityCodeOf(severity) == -1)
+            return reject(AdmitStatus::InvalidSeverity);
+        bool claimed = false;
+        if (doctorId == -1)
+        {
+            int claim = claimDoctor(disease);
+            if (claim == DoctorRecommender::FULL)
+                return reject(AdmitStatus::DoctorsFull);
+            claimed = claim != DoctorRecommender::NONE;
+            doctorId = claimed ? claim : 0; // the first doctor, as recommendLeastCostDoctor
+        }
+
+        int roomIndex = allocateRoom(emergency, doctorId);
+        if (roomIndex == -1)
+        {
+            if (claimed)
+                recommender.release(doctorId);
+            return reject(AdmitStatus::NoRoom);
+        }
+
+        PatientId id = addPatientRecord(emergency, name, disease, doctorId, severity, roomIndex + 1);
+        if (claimed)
+            recommender.release(doctorId); // the patient now counts against the doctor
+        journalAdmit(id);
+        return {AdmitStatus::Admitted, id, doctorId, roomIndex + 1};
+    }
+
+    // The running totals of every shard combined. All shards are held together, briefly, so
+    // a patient discharged from one shard and a patient admitted to another are never both
+    // counted.
+    CensusStats mergedStats() const
+    {
+        CensusStats stats;
+        stats.reset(doctors.size());
+        auto locks = census.lockAll();
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+            stats.merge(census.shard(i).stats);
+        return stats;
+    }
+
+    // Builds a report from running totals in O(doctors + diseases)
+    Summary summaryOf(const CensusStats &stats) const
+    {
+        Summary summary;
+        summary.doctors.reserve(doctors.size());
+        for (int id = 0; id < doctors.size(); id++)
+            summary.doctors.push_back({doctors.nameOf(id), stats.doctorPatientCount(id), stats.doctorRevenueOf(id)});
+        summary.totalRevenue = stats.totalRevenue();
+        summary.patients = stats.patientCount();
+        summary.emergencies = stats.emergencyCount();
+
+        for (int code = 0; code < diseaseIndex.size(); code++)
+            if (stats.diseaseCount(code) > 0)
+                summary.byDisease.push_back({diseaseIndex.all()[code], stats.diseaseCount(code)});
+        if (stats.unknownDiseaseCount() > 0)
+            summary.byDisease.push_back({"Other", stats.unknownDiseaseCount()});
+
+        const vector<string> &severities = diseaseIndex.allSeverities();
+        for (int code = 0; code < (int)severities.size(); code++)
+            if (stats.severityCount(code) > 0)
+                summary.bySeverity.push_back({severities[code], stats.severityCount(code)});
+        if (stats.unknownSeverityCount() > 0)
+            summary.bySeverity.push_back({"Other", stats.unknownSeverityCount()});
+        return summary;
+    }
+
+    bool isCurrent(const CensusSnapshot &snap) const
+    {
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+            if (census.shard(i).version.load() != snap.shardVersion(i))
+                return false;
+        return true;
+    }
+
+    // What a snapshot takes from the live census while every shard is held: each shard's
+    // change log (or all of its patients), versions, totals and name tables
+    struct SnapshotCut
+    {
+        struct Shard
+        {
+            bool full = false;
+            RecordChunk admitted; // or every record when full
+            vector<PatientId> discharged;
+        };
+        vector<Shard> shards = vector<Shard>(PATIENT_SHARDS);
+        vector<uint64_t> versions = vector<uint64_t>(PATIENT_SHARDS);
+        CensusStats stats;
+        CensusSnapshot::Names diseaseNames, severityNames, doctorNames;
+        int roomCount = 0;
+    };
+
+    // Takes the cut for a snapshot following `previous`. Shards whose log overflowed, or
+    // every shard when there is no previous snapshot, are copied whole. Caller holds
+    // snapshotLock and stateLock, either shared or exclusive.
+    void cutSnapshot(SnapshotCut &cut, const CensusSnapshot *previous) const
+    {
+        cut.stats.reset(doctors.size());
+        auto locks = census.lockAll();
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            const PatientCensus::Shard &shard = census.shard(i);
+            cut.versions[i] = shard.version.load();
+            cut.stats.merge(shard.stats);
+            if (!previous || shard.logOverflowed)
+            {
+                cut.shards[i].full = true;
+                cut.shards[i].admitted.records.reserve(shard.store.size());
+                for (Patient p : shard.store)
+                    cut.shards[i].admitted.append(p);
+                shard.admittedLog.clear();
+                shard.dischargedLog.clear();
+                shard.logOverflowed = false;
+            }
+            else
+            {
+                swap(cut.shards[i].admitted, shard.admittedLog);
+                swap(cut.shards[i].discharged, shard.dischargedLog);
+            }
+        }
+
+        // Code tables only grow, so an unchanged size means unchanged names
+        auto names = [](const CodeTable &table, const CensusSnapshot::Names &before)
+        {
+            if (before && before->size() == table.size())
+                return before;
+            auto copy = make_shared<vector<string>>();
+            for (size_t code = 0; code < table.size(); code++)
+                copy->push_back(table.nameOf((uint16_t)code));
+            return CensusSnapshot::Names(copy);
+        };
+        cut.diseaseNames = names(census.diseaseTable(), previous ? previous->diseaseTable() : nullptr);
+        cut.severityNames = names(census.severityTable(), previous ? previous->severityTable() : nullptr);
+        if (previous && (int)previous->doctorTable()->size() == doctors.size())
+            cut.doctorNames = previous->doctorTable();
+        else
+        {
+            auto copy = make_shared<vector<string>>();
+            for (int id = 0; id < doctors.size(); id++)
+                copy->push_back(doctors.nameOf(id));
+            cut.doctorNames = copy;
+        }
+        cut.roomCount = rooms.size();
+    }
+
+    // Rebuilds the chunks a cut touched, starting from `previous`; needs no lock but
+    // snapshotLock, so admissions carry on meanwhile
+    shared_ptr<const CensusSnapshot> finishSnapshot(SnapshotCut &cut, const CensusSnapshot *previous) const
+    {
+        vector<shared_ptr<const CensusSnapshot::ShardView>> views(PATIENT_SHARDS);
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            SnapshotCut::Shard &s = cut.shards[i];
+            if (s.full)
+                views[i] = CensusSnapshot::build(s.admitted);
+            else if (s.admitted.empty() && s.discharged.empty())
+                views[i] = previous->shard(i);
+            else
+                views[i] = CensusSnapshot::apply(*previous->shard(i), s.admitted, s.discharged);
+        }
+        return make_shared<const CensusSnapshot>(move(views), move(cut.versions), cut.diseaseNames, cut.severityNames, cut.doctorNames,
+                                                 summaryOf(cut.stats), cut.roomCount);
+    }
+
+    // Cuts a new snapshot. All shards are held together just long enough to take their
+    // change logs and totals; the chunks are rebuilt after the locks are dropped. Caller
+    // holds snapshotLock but not stateLock.
+    shared_ptr<const CensusSnapshot> buildSnapshot(const CensusSnapshot *previous) const
+    {
+        SnapshotCut cut;
+        {
+            shared_lock<shared_mutex> shared(stateLock);
+            cutSnapshot(cut, previous);
+        }
+        return finishSnapshot(cut, previous);
+    }
+
+    // Fills `cp` from the live state and takes the census cut into `cut`. Caller holds
+    // checkpointLock, snapshotLock and stateLock exclusively, so the patients, rooms, doctor
+    // counts and journal position all agree. With `mark` the capture is the next generation
+    // and the journal records where it was taken; a text export keeps the current one.
+    void captureLocked(Checkpoint &cp, SnapshotCut &cut, shared_ptr<const CensusSnapshot> &previous, bool mark)
+    {
+        previous = atomic_load(&published);
+        if (previous && isCurrent(*previous))
+            cp.census = previous;
+        else
+            cutSnapshot(cut, previous.get());
+
+        cp.generation = mark ? generation + 1 : generation;
+        cp.nextPatientId = census.peekNextId();
+        for (auto d : doctors.all())
+        {
+            cp.doctors.push_back({d->getName(), d->getSpecialties(), d->getSurcharge()});
+            cp.doctorPatients.push_back(d->getPatientCount());
+        }
+        cp.roomWords = rooms.bitmap();
+        cp.roomCount = rooms.size();
+        cp.wards = wards;
+        if (mark)
+        {
+            lock_guard<mutex> guard(journalLock);
+            cp.marked = journal.isOpen() && journal.markCheckpoint(cp.generation);
+        }
+    }
+
+    // Rebuilds the census chunks of a capture and publishes them as the latest snapshot.
+    // Needs snapshotLock only, so admissions carry on meanwhile.
+    void finishCapture(Checkpoint &cp, SnapshotCut &cut, const shared_ptr<const CensusSnapshot> &previous)
+    {
+        if (cp.census)
+            return;
+        cp.census = finishSnapshot(cut, previous.get());
+        atomic_store(&published, cp.census);
+    }
+
+    // Captures a checkpoint, holding stateLock exclusively only for the cut. Caller holds
+    // checkpointLock.
+    Checkpoint capture(bool mark)
+    {
+        HOSPITAL_METRIC(Capture);
+        Checkpoint cp;
+        SnapshotCut cut;
+        shared_ptr<const CensusSnapshot> previous;
+        lock_guard<mutex> guard(snapshotLock);
+        {
+            unique_lock<shared_mutex> exclusive(stateLock);
+            captureLocked(cp, cut, previous, mark);
+        }
+        finishCapture(cp, cut, previous);
+        return cp;
+    }
+
+    bool writeCheckpoint(const Checkpoint &cp)
+    {
+        return config.format == SnapshotFormat::Binary ? saveBinary(config.snapshotFile, cp) : saveText(config.dataFile, cp);
+    }
+
+    // Adopts a written checkpoint's generation and cuts the journal down to what followed
+    // it; a failed one leaves both alone. Caller holds checkpointLock.
+    void finishCheckpoint(const Checkpoint &cp, bool written)
+    {
+        lock_guard<mutex> guard(journalLock);
+        if (!written)
+        {
+            if (cp.marked)
+                journal.abandonCheckpoint();
+            return;
+        }
+        generation = cp.generation;
+        if (cp.marked)
+            journal.finishCheckpoint(cp.generation);
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+            savedVersions[i] = cp.census->shardVersion(i);
+    }
+
+    bool hasUnsavedChanges() const
+    {
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+            if (census.shard(i).version.load() != savedVersions[i])
+                return true;
+        return false;
+    }
+
+    // Captures and writes a snapshot of the next generation, then compacts the journal.
+    // stateLock is held only for the capture, so admissions go on during the write.
+    bool checkpoint(bool onlyIfChanged)
+    {
+        lock_guard<mutex> guard(checkpointLock);
+        if (onlyIfChanged && !hasUnsavedChanges())
+            return true;
+        HOSPITAL_METRIC(Save);
+        Checkpoint cp = capture(true);
+        bool written = writeCheckpoint(cp);
+        if (!written)
+            HOSPITAL_METRIC_FAIL();
+        finishCheckpoint(cp, written);
+        return written;
+    }
+
+    // Background writer: checkpoints on request and, with autosave, every interval that
+    // left unsaved changes behind. A request pending at shutdown is still carried out.
+    void writerLoop()
+    {
+        chrono::seconds interval(max(0, config.autosaveSeconds));
+        unique_lock<mutex> lock(writerLock);
+        while (true)
+        {
+            auto woken = [this]
+            { return writerRequested || writerStopping; };
+            bool due = false;
+            if (interval.count() > 0)
+                due = !writerWake.wait_for(lock, interval, woken);
+            else
+                writerWake.wait(lock, woken);
+            bool requested = writerRequested, stopping = writerStopping;
+            writerRequested = false;
+            writerBusy = requested || due;
+            lock.unlock();
+            if ((requested || due) && !checkpoint(!requested))
+                cerr << "Warning: background checkpoint failed; changes are kept in the journal.\n";
+            lock.lock();
+            writerBusy = false;
+            if (stopping)
+                return;
+        }
+    }
+
+    // Caller holds writerLock
+    void wakeWriter()
+    {
+        writerRequested = true;
+        if (!writer.joinable())
+            writer = thread(&Hospital::writerLoop, this);
+        writerWake.notify_one();
+    }
+
+    enum class LoadResult
+    {
+        Loaded,
+        Missing,
+        Corrupt
+    };
+
+    // Drops all patients and returns doctors and rooms to their empty state
+    void resetCensus()
+    {
+        census.clear(doctors.size());
+        for (auto d : doctors.all())
+            d->setPatientCount(0);
+        recommender.rebuild(diseaseIndex, doctors, tariffSchedule);
+        rooms.reset(freshWards->rooms());
+        setTopology(freshWards);
+        occupants.reset(rooms.size());
+    }
+
+    // Lays `topology` over the rooms, which must number topology->rooms(), and looks up the
+    // home ward of every doctor; a doctor listed by two wards belongs to the first
+    void setTopology(shared_ptr<const WardTopology> topology)
+    {
+        wards = move(topology);
+        rooms.partition(wards->roomStarts());
+        doctorWard.assign(doctors.size(), -1);
+        for (int w = wards->size() - 1; w >= 0; w--)
+        {
+            for (auto &name : wards->ward(w).doctors)
+            {
+                int id = doctors.findId(name);
+                if (id >= 0)
+                    doctorWard[id] = w;
+            }
+        }
+    }
+
+    // The wards for a loaded save of `roomCount` rooms: the ones it recorded, else the
+    // configured ones if they have as many rooms, else a single ward
+    shared_ptr<const WardTopology> wardsFor(int roomCount, vector<WardSpec> saved) const
+    {
+        if (!saved.empty())
+            return make_shared<const WardTopology>(move(saved));
+        if (freshWards->rooms() == roomCount)
+            return freshWards;
+        return make_shared<const WardTopology>(WardTopology::single(roomCount));
+    }
+
+    // Re-derives the room table from the census once a load has settled the room count
+    void rebuildOccupants()
+    {
+        occupants.reset(rooms.size());
+        census.forEach([this](const Patient &p)
+                       { occupants.set(p.getRoomNumber(), p.getId()); });
+    }
+
+    bool saveText(const string &path, const Checkpoint &cp)
+    {
+        string temp = path + ".tmp";
+        ofstream out(temp, ios::trunc);
+        if (!out)
+            return false;
+
+        out << "GENERATION " << cp.generation << "\n";
+        out << "NEXT_PATIENT_ID " << cp.nextPatientId << "\n";
+
+        // Save doctors, in Doctor::save's layout
+        out << "DOCTORS " << cp.doctors.size() << "\n";
+        for (size_t i = 0; i < cp.doctors.size(); i++)
+        {
+            const DoctorSpec &d = cp.doctors[i];
+            out << "DOCTOR\n"
+                << d.name << "\n"
+                << cp.doctorPatients[i] << "\n"
+                << d.surcharge << "\n"
+                << d.specialties.size() << "\n";
+            for (auto &spec : d.specialties)
+                out << spec << "\n";
+        }
+
+        // Save patients
+        out << "PATIENTS " << cp.census->size() << "\n";
+        cp.census->forEach([&out](const CensusSnapshot::Entry &p)
+                           { p.save(out); });
+
+        // Save rooms
+        out << "ROOMS " << cp.roomCount << "\n";
+        for (int i = 0; i < cp.roomCount; i++)
+            out << ((cp.roomWords[i >> 6] >> (i & 63)) & 1 ? "1" : "0") << "\n";
+
+        // Save wards, which number the rooms above in order
+        out << "WARDS " << cp.wards->size() << "\n";
+        for (auto &w : cp.wards->all())
+        {
+            out << "WARD\n"
+                << w.name << "\n"
+                << w.floor << "\n"
+                << roomTypeName(w.type) << "\n"
+                << w.rooms << "\n"
+                << (w.emergency ? 1 : 0) << "\n"
+                << w.doctors.size() << "\n";
+            for (auto &doctor : w.doctors)
+                out << doctor << "\n";
+        }
+
+        out.close();
+        return !out.fail() && replaceFile(temp, path);
+    }
+
+    // Loads a text save. The file is mapped in one block and scanned with LineCursor; the
+    // PATIENTS section is split into runs of records parsed on separate threads, then added
+    // to the census in file order so that fresh IDs come out as they always have. Malformed
+    // records are skipped or patched exactly as before and reported by line number.
+    bool loadText(const string &path)
+    {
+        MappedFile file(path);
+        if (!file.isOpen() && !ifstream(path))
+            return false; // an empty file maps to nothing but is still a (blank) save
+
+        // Clear existing patients but keep fresh doctors
+        resetCensus();
+
+        generation = 0;
+        vector<LoadWarning> warnings;
+        vector<WardSpec> savedWards;
+        bool wardsValid = true;
+        size_t wardsLine = 0;
+        auto after = [](string_view line, size_t n)
+        { return line.substr(min(n, line.size())); };
+        auto startsWith = [](string_view line, const char *keyword)
+        { return line.compare(0, strlen(keyword), keyword) == 0; };
+
+        LineCursor cursor(file.data(), file.data() + file.size());
+        string_view line;
+        while (cursor.next(line))
+        {
+            if (startsWith(line, "GENERATION"))
+            {
+                generation = (uint64_t)max(0, parseInt(after(line, 11), 0));
+            }
+            else if (startsWith(line, "NEXT_PATIENT_ID"))
+            {
+                census.reserveIdsBelow((PatientId)max(1, parseInt(after(line, 16), 1)));
+            }
+            else if (startsWith(line, "DOCTORS"))
+            {
+                // Skip doctors section - we use fresh doctors
+                int numDoctors = parseInt(after(line, 8), 0);
+                string_view marker;
+                for (int i = 0; i < numDoctors; i++)
+                {
+                    cursor.next(marker); // Skip doctor data
+                    if (marker != "DOCTOR")
+                        break;
+                    cursor.skip(3);
+                    cursor.next(marker); // Skip doctor details
+                    cursor.skip(max(0, parseInt(marker, 0))); // Skip specialties
+                }
+            }
+            else if (startsWith(line, "PATIENTS"))
+            {
+                int numPatients = parseInt(after(line, 9), 0);
+                loadTextPatients(cursor, numPatients > 0 ? numPatients : 0, warnings);
+            }
+            else if (startsWith(line, "ROOMS"))
+            {
+                int numRooms = parseInt(after(line, 6), TOTAL_ROOMS);
+                rooms.resize(numRooms);
+                string_view occupied;
+                for (int i = 0; i < numRooms; ++i)
+                {
+                    if (!cursor.next(occupied))
+                        break;
+                    if (occupied == "1")
+                        rooms.reserve(i);
+                    else
+                        rooms.release(i);
+                }
+            }
+            else if (startsWith(line, "WARDS"))
+            {
+                wardsLine = cursor.line() - 1;
+                int numWards = parseInt(after(line, 6), 0);
+                string_view marker, name, floor, type, count, emergency, doctorCount, doctor;
+                for (int i = 0; i < numWards && wardsValid; i++)
+                {
+                    wardsValid = cursor.next(marker) && marker == "WARD" && cursor.next(name) && cursor.next(floor) && cursor.next(type) &&
+                                 cursor.next(count) && cursor.next(emergency) && cursor.next(doctorCount);
+                    if (!wardsValid)
+                        break;
+                    WardSpec ward;
+                    bool floorOk, roomsOk;
+                    ward.name = string(name);
+                    ward.floor = parseInt(floor, 1, &floorOk);
+                    ward.rooms = parseInt(count, 0, &roomsOk);
+                    ward.emergency = emergency == "1";
+                    wardsValid = floorOk && roomsOk && ward.rooms > 0 && parseRoomType(type, ward.type);
+                    for (int d = max(0, parseInt(doctorCount, 0)); d > 0 && cursor.next(doctor); d--)
+                        ward.doctors.emplace_back(doctor);
+                    savedWards.push_back(move(ward));
+                }
+            }
+        }
+
+        long long wardRooms = 0;
+        for (auto &w : savedWards)
+            wardRooms += w.rooms;
+        if (!savedWards.empty() && (!wardsValid || wardRooms != rooms.size()))
+        {
+            warnings.push_back({wardsLine, "ward list is damaged or does not cover the " + to_string(rooms.size()) + " rooms; ignored"});
+            savedWards.clear();
+        }
+        setTopology(wardsFor(rooms.size(), move(savedWards)));
+        rebuildOccupants();
+
+        const size_t shown = 10;
+        for (size_t i = 0; i < warnings.size() && i < shown; i++)
+            cout << "Warning: " << path << " line " << warnings[i].line << ": " << warnings[i].message << "\n";
+        if (warnings.size() > shown)
+            cout << "Warning: " << warnings.size() - shown << " more malformed record(s) in " << path << "\n";
+        return true;
+    }
+
+    // Reads `count` PATIENTS records from `cursor` and leaves it after the section
+    void loadTextPatients(LineCursor &cursor, size_t count, vector<LoadWarning> &warnings)
+    {
+        // Find where each run starts; records are always six lines, even skipped ones
+        const size_t minRun = 16384;
+        size_t threads = max(1u, thread::hardware_concurrency());
+        size_t perRun = max(minRun, (count + threads - 1) / threads);
+        vector<pair<LineCursor, size_t>> runs; // start, records
+        for (size_t done = 0; done < count;)
+        {
+            size_t want = min(perRun, count - done);
+            LineCursor start = cursor;
+            size_t lines = cursor.skip(want * TEXT_PATIENT_LINES);
+            size_t records = (lines + TEXT_PATIENT_LINES - 1) / TEXT_PATIENT_LINES;
+            if (records > 0)
+                runs.push_back({start, records});
+            if (records < want)
+                break; // end of file
+            done += want;
+        }
+
+        vector<vector<TextPatient>> parsed(runs.size());
+        vector<vector<LoadWarning>> runWarnings(runs.size());
+        auto parse = [&](size_t r)
+        {
+            parsed[r].reserve(runs[r].second);
+            parseTextPatients(runs[r].first, runs[r].second, doctors, parsed[r], runWarnings[r]);
+        };
+        vector<thread> workers;
+        for (size_t r = 1; r < runs.size(); r++)
+            workers.emplace_back(parse, r);
+        if (!runs.empty())
+            parse(0);
+        for (auto &w : workers)
+            w.join();
+
+        size_t total = 0, nameBytes = 0;
+        for (auto &run : parsed)
+        {
+            total += run.size();
+            for (auto &rec : run)
+                nameBytes += rec.name.size();
+        }
+        census.reserve(total, nameBytes);
+        for (size_t r = 0; r < runs.size(); r++)
+        {
+            for (auto &rec : parsed[r])
+            {
+                addPatientRecord(rec.emergency, rec.name, rec.disease, rec.doctorId, rec.severity, rec.roomNumber, rec.id);
+
+                // Update room status
+                rooms.reserve(rec.roomNumber - 1);
+            }
+            warnings.insert(warnings.end(), runWarnings[r].begin(), runWarnings[r].end());
+        }
+    }
+
+    static uint64_t align8(uint64_t offset) { return (offset + 7) & ~7ULL; }
+
+    bool saveBinary(const string &path, const Checkpoint &cp)
+    {
+        SnapshotStringTable strings;
+
+        vector<SnapshotDoctor> doctorRecords;
+        vector<SnapshotString> specialtyRefs;
+        doctorRecords.reserve(cp.doctors.size());
+        for (size_t i = 0; i < cp.doctors.size(); i++)
+        {
+            const DoctorSpec &d = cp.doctors[i];
+            SnapshotDoctor rec = {};
+            rec.name = strings.add(d.name);
+            rec.firstSpecialty = (uint32_t)specialtyRefs.size();
+            rec.specialtyCount = (uint32_t)d.specialties.size();
+            rec.patientCount = cp.doctorPatients[i];
+            rec.surcharge = d.surcharge;
+            for (auto &spec : d.specialties)
+                specialtyRefs.push_back(strings.add(spec));
+            doctorRecords.push_back(rec);
+        }
+
+        vector<SnapshotPatient> patientRecords;
+        patientRecords.reserve(cp.census->size());
+        int doctorCount = (int)cp.doctors.size();
+        cp.census->forEach([&](const CensusSnapshot::Entry &p)
+                           {
+            SnapshotPatient rec = {};
+            rec.name = strings.add(p.getName());
+            rec.disease = strings.add(p.getDisease());
+            rec.severity = strings.add(p.getSeverity());
+            rec.doctor = p.getDoctorId() >= 0 && p.getDoctorId() < doctorCount ? p.getDoctorId() : -1;
+            rec.roomNumber = p.getRoomNumber();
+            rec.flags = p.isEmergency() ? SNAPSHOT_EMERGENCY : 0;
+            rec.id = p.getId();
+            patientRecords.push_back(rec); });
+
+        const vector<uint64_t> &roomWords = cp.roomWords;
+
+        vector<SnapshotWard> wardRecords;
+        vector<SnapshotString> wardDoctorRefs;
+        for (auto &w : cp.wards->all())
+        {
+            SnapshotWard rec = {};
+            rec.name = strings.add(w.name);
+            rec.floor = w.floor;
+            rec.rooms = (uint32_t)w.rooms;
+            rec.firstDoctor = (uint32_t)wardDoctorRefs.size();
+            rec.doctorCount = (uint32_t)w.doctors.size();
+            rec.type = (uint8_t)w.type;
+            rec.flags = w.emergency ? SNAPSHOT_EMERGENCY : 0;
+            for (auto &doctor : w.doctors)
+                wardDoctorRefs.push_back(strings.add(doctor));
+            wardRecords.push_back(rec);
+        }
+
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.headerSize = sizeof(SnapshotHeader);
+        header.generation = cp.generation;
+        header.stringTableOffset = sizeof(SnapshotHeader);
+        header.stringTableSize = strings.bytes().size();
+        header.doctorOffset = align8(header.stringTableOffset + header.stringTableSize);
+        header.doctorCount = (uint32_t)doctorRecords.size();
+        header.specialtyOffset = align8(header.doctorOffset + doctorRecords.size() * sizeof(SnapshotDoctor));
+        header.specialtyCount = (uint32_t)specialtyRefs.size();
+        header.patientOffset = align8(header.specialtyOffset + specialtyRefs.size() * sizeof(SnapshotString));
+        header.patientCount = (uint32_t)patientRecords.size();
+        header.roomOffset = align8(header.patientOffset + patientRecords.size() * sizeof(SnapshotPatient));
+        header.roomCount = (uint32_t)cp.roomCount;
+        header.nextPatientId = cp.nextPatientId;
+        header.wardOffset = align8(header.roomOffset + roomWords.size() * sizeof(uint64_t));
+        header.wardCount = (uint32_t)wardRecords.size();
+        header.wardDoctorOffset = align8(header.wardOffset + wardRecords.size() * sizeof(SnapshotWard));
+        header.wardDoctorCount = (uint32_t)wardDoctorRefs.size();
+
+        string temp = path + ".tmp";
+        ofstream out(temp, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        auto writeAt = [&out](uint64_t offset, const void *bytes, size_t size)
+        {
+            static const char zeros[8] = {};
+            uint64_t pos = (uint64_t)out.tellp();
+            if (offset > pos)
+                out.write(zeros, offset - pos); // alignment padding
+            out.write((const char *)bytes, size);
+        };
+        writeAt(0, &header, sizeof(header));
+        writeAt(header.stringTableOffset, strings.bytes().data(), strings.bytes().size());
+        writeAt(header.doctorOffset, doctorRecords.data(), doctorRecords.size() * sizeof(SnapshotDoctor));
+        writeAt(header.specialtyOffset, specialtyRefs.data(), specialtyRefs.size() * sizeof(SnapshotString));
+        writeAt(header.patientOffset, patientRecords.data(), patientRecords.size() * sizeof(SnapshotPatient));
+        writeAt(header.roomOffset, roomWords.data(), roomWords.size() * sizeof(uint64_t));
+        writeAt(header.wardOffset, wardRecords.data(), wardRecords.size() * sizeof(SnapshotWard));
+        writeAt(header.wardDoctorOffset, wardDoctorRefs.data(), wardDoctorRefs.size() * sizeof(SnapshotString));
+
+        out.close();
+        return !out.fail() && replaceFile(temp, path);
+    }
+
+    LoadResult loadBinary(const string &path)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+            return LoadResult::Missing;
+
+        // Validate the header and that every section lies inside the file before touching records
+        if (!file.contains(0, SNAPSHOT_NO_WARDS_HEADER_SIZE))
+            return LoadResult::Corrupt;
+        const SnapshotHeader *stored = (const SnapshotHeader *)file.data();
+        bool current = stored->version == SNAPSHOT_VERSION && stored->headerSize == sizeof(SnapshotHeader);
+        bool noWards = stored->version == SNAPSHOT_VERSION_NO_WARDS && stored->headerSize == SNAPSHOT_NO_WARDS_HEADER_SIZE;
+        if (memcmp(stored->magic, SNAPSHOT_MAGIC, sizeof(stored->magic)) != 0 || !(current || noWards) ||
+            !file.contains(0, stored->headerSize))
+            return LoadResult::Corrupt;
+        SnapshotHeader fields = {}; // a version 3 header leaves the ward fields 0
+        memcpy(&fields, stored, stored->headerSize);
+        const SnapshotHeader *header = &fields;
+
+        uint64_t roomWordCount = ((uint64_t)header->roomCount + 63) / 64;
+        if (!file.contains(header->stringTableOffset, header->stringTableSize) ||
+            !file.contains(header->doctorOffset, (uint64_t)header->doctorCount * sizeof(SnapshotDoctor)) ||
+            !file.contains(header->specialtyOffset, (uint64_t)header->specialtyCount * sizeof(SnapshotString)) ||
+            !file.contains(header->patientOffset, (uint64_t)header->patientCount * sizeof(SnapshotPatient)) ||
+            !file.contains(header->roomOffset, roomWordCount * sizeof(uint64_t)) ||
+            (header->doctorOffset | header->specialtyOffset | header->patientOffset | header->roomOffset) % 8 != 0 ||
+            header->roomCount > (uint32_t)numeric_limits<int>::max())
+            return LoadResult::Corrupt;
+        if (header->wardCount &&
+            (!file.contains(header->wardOffset, (uint64_t)header->wardCount * sizeof(SnapshotWard)) ||
+             !file.contains(header->wardDoctorOffset, (uint64_t)header->wardDoctorCount * sizeof(SnapshotString)) ||
+             (header->wardOffset | header->wardDoctorOffset) % 8 != 0))
+            return LoadResult::Corrupt;
+
+        const char *stringTable = file.data() + header->stringTableOffset;
+        auto validString = [header](const SnapshotString &ref)
+        {
+            return (uint64_t)ref.offset + ref.length <= header->stringTableSize;
+        };
+        auto text = [stringTable](const SnapshotString &ref)
+        {
+            return string_view(stringTable + ref.offset, ref.length);
+        };
+
+        // Map snapshot doctor slots to current registry IDs once, not once per patient
+        const SnapshotDoctor *doctorRecords = (const SnapshotDoctor *)(file.data() + header->doctorOffset);
+        vector<int> doctorIds(header->doctorCount, -1);
+        for (uint32_t i = 0; i < header->doctorCount; i++)
+        {
+            if (validString(doctorRecords[i].name))
+                doctorIds[i] = doctors.findId(text(doctorRecords[i].name));
+        }
+
+        // The wards must be intact and number exactly the saved rooms
+        const SnapshotWard *wardRecords = (const SnapshotWard *)(file.data() + header->wardOffset);
+        const SnapshotString *wardDoctorRefs = (const SnapshotString *)(file.data() + header->wardDoctorOffset);
+        vector<WardSpec> savedWards;
+        uint64_t wardRooms = 0;
+        for (uint32_t i = 0; i < header->wardCount; i++)
+        {
+            const SnapshotWard &rec = wardRecords[i];
+            if (!validString(rec.name) || rec.type > (uint8_t)RoomType::Isolation || rec.rooms == 0 ||
+                (uint64_t)rec.firstDoctor + rec.doctorCount > header->wardDoctorCount)
+                return LoadResult::Corrupt;
+            WardSpec ward;
+            ward.name = string(text(rec.name));
+            ward.floor = rec.floor;
+            ward.type = (RoomType)rec.type;
+            ward.rooms = (int)rec.rooms;
+            ward.emergency = (rec.flags & SNAPSHOT_EMERGENCY) != 0;
+            for (uint32_t d = rec.firstDoctor; d < rec.firstDoctor + rec.doctorCount; d++)
+            {
+                if (!validString(wardDoctorRefs[d]))
+                    return LoadResult::Corrupt;
+                ward.doctors.emplace_back(text(wardDoctorRefs[d]));
+            }
+            wardRooms += rec.rooms;
+            savedWards.push_back(move(ward));
+        }
+        if (header->wardCount && wardRooms != header->roomCount)
+            return LoadResult::Corrupt;
+
+        resetCensus();
+        generation = header->generation;
+        census.reserveIdsBelow(header->nextPatientId);
+
+        const SnapshotPatient *patientRecords = (const SnapshotPatient *)(file.data() + header->patientOffset);
+        // Size every column and the name arena once for the whole census
+        size_t nameBytes = 0;
+        for (uint32_t i = 0; i < header->patientCount; i++)
+            nameBytes += patientRecords[i].name.length;
+        census.reserve(header->patientCount, nameBytes);
+        map<string, size_t> unknownDoctors;
+        for (uint32_t i = 0; i < header->patientCount; i++)
+        {
+            const SnapshotPatient &rec = patientRecords[i];
+            if (!validString(rec.name) || !validString(rec.disease) || !validString(rec.severity))
+                continue; // skip damaged records, as the text loader does
+
+            bool hasDoctor = rec.doctor >= 0 && (uint32_t)rec.doctor < header->doctorCount;
+            int docId = hasDoctor ? doctorIds[rec.doctor] : -1;
+            if (docId == -1 && hasDoctor && validString(doctorRecords[rec.doctor].name))
+                unknownDoctors[string(text(doctorRecords[rec.doctor].name))]++;
+            addPatientRecord((rec.flags & SNAPSHOT_EMERGENCY) != 0, text(rec.name), text(rec.disease), docId, text(rec.severity),
+                             rec.roomNumber, rec.id);
+        }
+
+        rooms.loadBitmap((const uint64_t *)(file.data() + header->roomOffset), (int)header->roomCount);
+        setTopology(wardsFor((int)header->roomCount, move(savedWards)));
+        rebuildOccupants();
+        warnUnknownDoctors(path, unknownDoctors);
+        return LoadResult::Loaded;
+    }
+
+public:
+    Hospital(const HospitalConfig &cfg = HospitalConfig())
+        : rooms(max(1, cfg.roomCount)), census(&doctors), config(cfg), generation(0), journal(cfg.groupCommitRecords, cfg.groupCommitMillis)
+    {
+        // Built-in tariffs come from the compile-time tables; a tariff file only adds overrides
+        string error;
+        if (!config.tariffFile.empty() && !tariffSchedule.load(config.tariffFile, error))
+            cout << "Warning: " << error << "; using the built-in tariffs.\n";
+
+        recommender.configure(config.loadWeight, config.doctorCap);
+        // Always start with fresh doctors, from the roster file if there is one
+        vector<DoctorSpec> fileRoster;
+        if (!config.rosterFile.empty() && !loadRoster(config.rosterFile, fileRoster, error))
+            cout << "Warning: " << error << "; using the " << (config.roster.empty() ? "built-in" : "configured") << " doctors.\n";
+        initializeDoctors(fileRoster.empty() ? config.roster : move(fileRoster));
+        for (auto &s : tariffSchedule.surcharges)
+            if (doctors.findId(s.first) < 0)
+                cout << "Warning: " << config.tariffFile << ": no doctor named " << s.first << "; surcharge ignored.\n";
+
+        // Rooms of a fresh hospital, grouped into the configured wards or else a single one
+        vector<WardSpec> fileWards;
+        if (!config.wardFile.empty() && !loadWards(config.wardFile, fileWards, error))
+            cout << "Warning: " << error << "; using " << (config.wards.empty() ? "a single ward" : "the configured wards") << ".\n";
+        if (!fileWards.empty())
+            config.wards = move(fileWards);
+        if (config.wards.empty())
+            freshWards = make_shared<const WardTopology>(WardTopology::single(max(1, config.roomCount)));
+        else
+            freshWards = make_shared<const WardTopology>(config.wards);
+        config.roomCount = freshWards->rooms();
+        for (auto &w : freshWards->all())
+            for (auto &name : w.doctors)
+                if (doctors.findId(name) < 0)
+                    cout << "Warning: " << (config.wardFile.empty() ? "wards" : config.wardFile) << ": no doctor named " << name << " in " << w.name << "; ignored.\n";
+        rooms.reset(freshWards->rooms());
+        setTopology(freshWards);
+        occupants.reset(rooms.size());
+        loadFromFile();
+        savedVersions.resize(PATIENT_SHARDS);
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+            savedVersions[i] = census.shard(i).version.load();
+        openJournal();
+        if (config.autosaveSeconds > 0)
+        {
+            lock_guard<mutex> guard(writerLock);
+            writer = thread(&Hospital::writerLoop, this);
+        }
+    }
+
+    ~Hospital()
+    {
+        {
+            lock_guard<mutex> guard(writerLock);
+            writerStopping = true;
+        }
+        writerWake.notify_one();
+        if (writer.joinable())
+            writer.join();
+    }
+
+    void showDiseases()
+    {
+        cout << "Available diseases:\n";
+        const vector<string> &diseaseList = diseaseIndex.all();
+        for (size_t i = 0; i < diseaseList.size(); i++)
+        {
+            cout << i + 1 << ". " << diseaseList[i] << "\n";
+        }
+    }
+
+    void showDoctorsForDisease(const string &disease)
+    {
+        cout << "Doctors who can treat " << disease << ":\n";
+        int code = diseaseIndex.codeOf(disease);
+        if (code != -1)
+        {
+            for (int id : diseaseIndex.doctorsFor(code))
+            {
+                Doctor *doc = doctors.get(id);
+                cout << "- " << doc->getName() << " (Current Patients: " << doc->getPatientCount() << ", Surcharge: Rs." << doc->getSurcharge() << ")\n";
+            }
+        }
+        else
+        {
+            cout << "No doctors found for this disease.\n";
+        }
+    }
+
+    double getDoctorSurcharge(int doctorId) const
+    {
+        return doctors.surchargeOf(doctorId);
+    }
+
+    // Returns the ID of the best-scoring doctor (the least-cost one unless a load weight is
+    // configured), the first doctor if none treats the disease, or -1 if all are at the cap
+    int recommendLeastCostDoctor(const string &disease, const string &severity)
+    {
+        HOSPITAL_METRIC(Recommend);
+        shared_lock<shared_mutex> shared(stateLock);
+        if (diseaseIndex.severityCodeOf(severity) == -1)
+            return 0;
+        int recommended = recommender.recommend(diseaseIndex.codeOf(disease));
+        if (recommended == DoctorRecommender::FULL)
+            return -1;
+        return recommended == DoctorRecommender::NONE ? 0 : recommended;
+    }
+
+    // Recommends a doctor and counts the admission against them until released; returns a
+    // doctor ID or DoctorRecommender::NONE or FULL
+    int claimDoctor(const string &disease)
+    {
+        HOSPITAL_METRIC(Recommend);
+        int claim = recommender.claim(diseaseIndex.codeOf(disease));
+        if (claim == DoctorRecommender::FULL)
+            HOSPITAL_METRIC_FAIL();
+        return claim;
+    }
+
+    // Programmatic admission shared by the menu and batch mode. An empty doctor name assigns
+    // the least-cost doctor for the disease and severity.
+    Admission admitPatient(const string &name, const string &disease, const string &severity, const string &doctorName = "", bool emergency = false)
+    {
+        Admission a;
+        {
+            shared_lock<shared_mutex> shared(stateLock);
+            int doctorId = -1;
+            if (!doctorName.empty())
+            {
+                doctorId = doctors.findId(doctorName);
+                if (doctorId == -1)
+                    return {AdmitStatus::UnknownDoctor, 0, -1, 0};
+            }
+            a = admit(emergency, name, disease, severity, doctorId);
+        }
+        compactIfNeeded();
+        return a;
+    }
+
+    Admission admitEmergencyPatient(const string &name, const string &disease, const string &severity, const string &doctorName = "")
+    {
+        return admitPatient(name, disease, severity, doctorName, true);
+    }
+
+    bool dischargeById(PatientId id)
+    {
+        {
+            HOSPITAL_METRIC(Discharge);
+            shared_lock<shared_mutex> shared(stateLock);
+            int room = applyDischarge(id);
+            if (room == -1)
+            {
+                HOSPITAL_METRIC_FAIL();
+                return false;
+            }
+            journalDischarge(id);
+            rooms.release(room);
+        }
+        compactIfNeeded();
+        return true;
+    }
+
+    bool hasPatient(PatientId id) const
+    {
+        shared_lock<shared_mutex> shared(stateLock);
+        return containsPatient(id);
+    }
+
+    bool billFor(PatientId id, Bill &bill) const
+    {
+        HOSPITAL_METRIC(Bill);
+        shared_lock<shared_mutex> shared(stateLock);
+        const PatientCensus::Shard &shard = census.shardFor(id);
+        lock_guard<mutex> guard(shard.lock);
+        Patient p = shard.store.find(id);
+        if (!p)
+        {
+            HOSPITAL_METRIC_FAIL();
+            return false;
+        }
+        bill.patientName = p.getName();
+        bill.disease = p.getDisease();
+        bill.severity = p.getSeverity();
+        bill.doctor = p.getAssignedDoctor();
+        bill.roomNumber = p.getRoomNumber();
+        bill.emergency = p.isEmergency();
+        bill.cost = p.getCachedBill();
+        return true;
+    }
+
+    // Returns an immutable view of the census that the caller can read without locks. When
+    // nothing changed since the last one was published this is one atomic load; otherwise
+    // the caller cuts a new version, which costs about as much as the changes since then.
+    shared_ptr<const CensusSnapshot> snapshot() const
+    {
+        shared_ptr<const CensusSnapshot> current = atomic_load(&published);
+        if (current && isCurrent(*current))
+            return current;
+        lock_guard<mutex> guard(snapshotLock);
+        current = atomic_load(&published);
+        if (current && isCurrent(*current))
+            return current;
+        current = buildSnapshot(current.get());
+        atomic_store(&published, current);
+        return current;
+    }
+
+    // A consistent report, taken from the latest snapshot
+    Summary summarize() const
+    {
+#ifdef HOSPITAL_VERIFY_AGGREGATES
+        verifyAggregates(cerr);
+#endif
+        HOSPITAL_METRIC(Report);
+        return snapshot()->report();
+    }
+
+    // Debug check: recomputes every report total from scratch and reports any drift from the
+    // running aggregates, the cached bills, the doctor counts or the room bitmap. Always available; summarize()
+    // runs it on every report when the program is built with -DHOSPITAL_VERIFY_AGGREGATES.
+    bool verifyAggregates(ostream &err) const
+    {
+        unique_lock<shared_mutex> exclusive(stateLock);
+        CensusStats expected;
+        expected.reset(doctors.size());
+        vector<bool> roomTaken(rooms.size(), false);
+        int mismatches = 0;
+        census.forEach([&](const Patient &p)
+                       {
+            double bill = p.calculateBill(tariffs, getDoctorSurcharge(p.getDoctorId()));
+            expected.apply(+1, p.getDoctorId(), diseaseIndex.codeOf(p.getDisease()), diseaseIndex.severityCodeOf(p.getSeverity()),
+                           p.isEmergency(), bill);
+            if (bill != p.getCachedBill())
+            {
+                err << "bill mismatch: patient " << p.getId() << " is billed " << p.getCachedBill() << ", tariff says " << bill << "\n";
+                mismatches++;
+            }
+            int room = p.getRoomNumber() - 1;
+            if (room < 0 || room >= rooms.size() || roomTaken[room] || !rooms.isOccupied(room))
+            {
+                err << "room mismatch: patient " << p.getId() << " holds room " << p.getRoomNumber() << "\n";
+                mismatches++;
+            }
+            else
+                roomTaken[room] = true; });
+
+        CensusStats stats = mergedStats();
+        auto check = [&](const string &what, double want, double got)
+        {
+            if (fabs(want - got) > 1e-6 * max(1.0, fabs(want)))
+            {
+                err << "aggregate mismatch: " << what << " expected " << want << ", running total " << got << "\n";
+                mismatches++;
+            }
+        };
+        check("patients", expected.patientCount(), stats.patientCount());
+        check("census size", expected.patientCount(), (double)census.size());
+        check("emergencies", expected.emergencyCount(), stats.emergencyCount());
+        check("total revenue", expected.totalRevenue(), stats.totalRevenue());
+        for (int id = 0; id < doctors.size(); id++)
+        {
+            check(doctors.nameOf(id) + " patients", expected.doctorPatientCount(id), stats.doctorPatientCount(id));
+            check(doctors.nameOf(id) + " patient count", expected.doctorPatientCount(id), doctors.get(id)->getPatientCount());
+            check(doctors.nameOf(id) + " revenue", expected.doctorRevenueOf(id), stats.doctorRevenueOf(id));
+        }
+        for (int code = 0; code < diseaseIndex.size(); code++)
+            check(diseaseIndex.all()[code] + " patients", expected.diseaseCount(code), stats.diseaseCount(code));
+        for (int code = 0; code < (int)diseaseIndex.allSeverities().size(); code++)
+            check(diseaseIndex.allSeverities()[code] + " patients", expected.severityCount(code), stats.severityCount(code));
+        check("other disease patients", expected.unknownDiseaseCount(), stats.unknownDiseaseCount());
+        check("other severity patients", expected.unknownSeverityCount(), stats.unknownSeverityCount());
+        check("wards", wards->size(), rooms.zones());
+        for (int w = 0; w < wards->size() && w < rooms.zones(); w++)
+        {
+            int free = 0;
+            for (int room = wards->firstRoom(w); room < wards->endRoom(w); room++)
+                free += !rooms.isOccupied(room);
+            check(wards->ward(w).name + " free rooms", free, rooms.availableIn(w));
+        }
+        return mismatches == 0;
+    }
+
+    size_t patientCount() const { return census.size(); }
+    int doctorCount() const { return doctors.size(); }
+
+    // Rooms, free rooms and doctors of every ward, in ward order
+    vector<WardOccupancy> wardOccupancy() const
+    {
+        shared_lock<shared_mutex> shared(stateLock);
+        vector<int> based(wards->size(), 0);
+        for (int w : doctorWard)
+            if (w >= 0)
+                based[w]++;
+        vector<WardOccupancy> result;
+        for (int w = 0; w < wards->size(); w++)
+        {
+            const WardSpec &spec = wards->ward(w);
+            result.push_back({spec.name, spec.floor, spec.type, spec.emergency, spec.rooms, max(0, rooms.availableIn(w)), based[w]});
+        }
+        return result;
+    }
+
+    void showWards() const
+    {
+        cout << "Wards:\n";
+        for (auto &w : wardOccupancy())
+            cout << "- " << w.name << " (Floor " << w.floor << ", " << roomTypeName(w.type) << (w.emergency ? ", emergency" : "")
+                 << "): " << w.free << " of " << w.rooms << " rooms free, " << w.doctors << " doctor(s) based here\n";
+    }
+    size_t emergencyCount() const { return census.emergencyCount(); }
+
+    // Totals every current patient's bill, shard by shard; threads = 0 uses every core. Bills
+    // are cached per patient and kept current by admissions and tariff reloads, so this only
+    // sums each shard's bill column.
+    double billAll(unsigned threads = 0) const
+    {
+        HOSPITAL_METRIC(BillAll);
+        shared_lock<shared_mutex> shared(stateLock);
+        double total = 0;
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            const PatientCensus::Shard &shard = census.shard(i);
+            lock_guard<mutex> guard(shard.lock);
+            total += BillingEngine::total(shard.store.billColumn(), threads);
+        }
+        return total;
+    }
+
+    // Bills a subset of patients from the bill cache; bills[i] pairs with ids[i], unknown IDs
+    // bill as 0
+    double billPatients(const vector<PatientId> &ids, vector<double> &bills, unsigned threads = 0) const
+    {
+        HOSPITAL_METRIC(BillAll);
+        shared_lock<shared_mutex> shared(stateLock);
+        bills.assign(ids.size(), 0);
+        double total = 0;
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            const PatientCensus::Shard &shard = census.shard(i);
+            lock_guard<mutex> guard(shard.lock);
+            vector<double> found;
+            for (size_t k = 0; k < ids.size(); k++)
+            {
+                if (ids[k] % PATIENT_SHARDS != (PatientId)i)
+                    continue;
+                uint32_t row = shard.store.rowFor(ids[k]);
+                if (row == PatientStore::NO_ROW)
+                    continue;
+                bills[k] = shard.store.bill(row);
+                found.push_back(bills[k]);
+            }
+            total += BillingEngine::total(found, threads);
+        }
+        return total;
+    }
+
+    // The tariff file in use, which reloadTariffs() reads again by default; empty for none
+    string tariffFile() const
+    {
+        shared_lock<shared_mutex> shared(stateLock);
+        return config.tariffFile;
+    }
+
+    // Replaces the tariffs with the built-in ones plus the file at `path`, so entries the file
+    // no longer lists go back to the built-in tariff and doctors to their roster surcharge.
+    // Only the patients whose disease, severity, doctor or emergency flag now has another
+    // price are rebilled, found through the query index, and the report totals move by the
+    // difference. The severities offered at admission stay those of startup. On failure
+    // `error` says why and nothing changes.
+    bool reloadTariffs(const string &path, TariffReload &result, string &error)
+    {
+        HOSPITAL_METRIC(Reload);
+        result = TariffReload();
+        TariffSchedule next;
+        if (!next.load(path, error))
+        {
+            HOSPITAL_METRIC_FAIL();
+            return false;
+        }
+
+        unique_lock<shared_mutex> exclusive(stateLock);
+        for (auto &s : next.surcharges)
+        {
+            if (doctors.findId(s.first) < 0)
+            {
+                error = path + ": no doctor named " + s.first;
+                HOSPITAL_METRIC_FAIL();
+                return false;
+            }
+        }
+
+        TariffTable before = tariffs;
+        vector<double> surchargesBefore(doctors.size());
+        for (int id = 0; id < doctors.size(); id++)
+            surchargesBefore[id] = doctors.surchargeOf(id);
+
+        tariffSchedule = move(next);
+        tariffs = TariffTable();
+        tariffs.emergencyFactor = tariffSchedule.emergencyFactor;
+        syncTariffs();
+        applySurcharges();
+        recommender.rebuild(diseaseIndex, doctors, tariffSchedule);
+
+        vector<uint16_t> diseases, severities;
+        vector<int> changedDoctors;
+        for (size_t code = 0; code < tariffs.diseaseCost.size(); code++)
+            if (tariffs.diseaseCost[code] != before.diseaseCost[code])
+                diseases.push_back((uint16_t)code);
+        for (size_t code = 0; code < tariffs.severityMultiplier.size(); code++)
+            if (tariffs.severityMultiplier[code] != before.severityMultiplier[code])
+                severities.push_back((uint16_t)code);
+        for (int id = 0; id < doctors.size(); id++)
+            if (doctors.surchargeOf(id) != surchargesBefore[id])
+                changedDoctors.push_back(id);
+        result.diseases = (int)diseases.size();
+        result.severities = (int)severities.size();
+        result.doctors = (int)changedDoctors.size();
+        result.emergency = tariffs.emergencyFactor != before.emergencyFactor;
+        config.tariffFile = path;
+
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            PatientCensus::Shard &shard = census.shard(i);
+            lock_guard<mutex> guard(shard.lock);
+            vector<PatientId> affected;
+            auto collect = [&affected](const PostingList *list)
+            {
+                if (list)
+                    list->scan(0, [&affected](PatientId id)
+                               { affected.push_back(id); return true; });
+            };
+            for (uint16_t code : diseases)
+                collect(shard.index.disease(code));
+            for (uint16_t code : severities)
+                collect(shard.index.severity(code));
+            for (int id : changedDoctors)
+                collect(shard.index.doctor(id));
+            if (result.emergency)
+                collect(&shard.index.emergencies());
+            sort(affected.begin(), affected.end());
+            affected.erase(unique(affected.begin(), affected.end()), affected.end());
+
+            size_t rebilled = result.rebilled;
+            for (PatientId id : affected)
+            {
+                uint32_t row = shard.store.rowFor(id);
+                Patient p(&shard.store, row);
+                double bill = p.calculateBill(tariffs, getDoctorSurcharge(p.getDoctorId()));
+                if (bill == p.getCachedBill())
+                    continue;
+                shard.stats.rebill(p.getDoctorId(), p.getCachedBill(), bill);
+                shard.store.setBill(row, bill);
+                result.rebilled++;
+            }
+            result.checked += affected.size();
+            if (result.rebilled != rebilled)
+                shard.version++; // the report totals moved; the patients did not
+        }
+        return true;
+    }
+
+    // Calls visit(const CensusSnapshot::Entry &) for every patient, or only the emergency
+    // ones, in ID order. It walks a snapshot and holds no lock, so `visit` may call back
+    // into Hospital; changes it makes are not seen by the walk.
+    template <typename Visit>
+    void forEachPatient(Visit visit, bool emergencyOnly = false) const
+    {
+        snapshot()->forEach(visit, emergencyOnly);
+    }
+
+    // Finds the patients matching every filter in `q`, in ID order, `pageSize` at a time
+    // after patient `after` (0 for the first page). The indexed filter with the fewest
+    // patients drives the search and the other filters are checked per candidate, so a page
+    // costs time in proportion to that filter's matches rather than to the census.
+    PatientPage queryPatients(const PatientQuery &q, PatientId after = 0, size_t pageSize = 50) const
+    {
+        HOSPITAL_METRIC(Query);
+        PatientPage page;
+        if (pageSize == 0)
+            return page;
+        shared_lock<shared_mutex> shared(stateLock);
+
+        // Resolve names to codes up front; a name no patient can have means no matches
+        int doctorId = q.doctor.empty() ? -1 : doctors.findId(q.doctor);
+        int disease = q.disease.empty() ? -1 : census.diseaseTable().find(q.disease);
+        int severity = q.severity.empty() ? -1 : census.severityTable().find(q.severity);
+        bool roomFilter = q.firstRoom > 0 || q.lastRoom > 0;
+        int firstRoom = max(1, q.firstRoom);
+        int lastRoom = q.lastRoom > 0 ? min(q.lastRoom, rooms.size()) : rooms.size();
+        if ((!q.doctor.empty() && doctorId == -1) || (!q.disease.empty() && disease == -1) ||
+            (!q.severity.empty() && severity == -1) || (roomFilter && firstRoom > lastRoom))
+            return page;
+
+        auto matches = [&](const Patient &p)
+        {
+            return (doctorId == -1 || p.getDoctorId() == doctorId) && (disease == -1 || p.getDiseaseCode() == disease) &&
+                   (severity == -1 || p.getSeverityCode() == severity) && (q.emergency == -1 || p.isEmergency() == (q.emergency == 1)) &&
+                   (!roomFilter || (p.getRoomNumber() >= firstRoom && p.getRoomNumber() <= lastRoom)) &&
+                   (q.namePrefix.empty() || p.getName().compare(0, q.namePrefix.size(), q.namePrefix) == 0);
+        };
+        auto infoOf = [](const Patient &p) -> PatientInfo
+        {
+            return {p.getId(), p.getName(), p.getDisease(), p.getSeverity(), p.getAssignedDoctor(), p.getRoomNumber(), p.isEmergency()};
+        };
+
+        // Plan: count each usable index's candidates over all shards and drive by the smallest
+        enum Driver
+        {
+            All,
+            Emergency,
+            Doctor,
+            Disease,
+            Severity,
+            Name,
+            Rooms,
+            DriverCount
+        };
+        auto listFor = [&](const PatientIndex &index, int driver) -> const PostingList *
+        {
+            switch (driver)
+            {
+            case All:
+                return &index.all();
+            case Emergency:
+                return q.emergency == 1 ? &index.emergencies() : nullptr;
+            case Doctor:
+                return doctorId == -1 ? nullptr : index.doctor(doctorId);
+            case Disease:
+                return disease == -1 ? nullptr : index.disease((uint16_t)disease);
+            case Severity:
+                return severity == -1 ? nullptr : index.severity((uint16_t)severity);
+            }
+            return nullptr;
+        };
+        size_t candidates[DriverCount] = {};
+        bool usable[DriverCount] = {true, q.emergency == 1, doctorId != -1, disease != -1, severity != -1, !q.namePrefix.empty(), roomFilter};
+        for (int i = 0; i < PATIENT_SHARDS; i++)
+        {
+            const PatientCensus::Shard &shard = census.shard(i);
+            lock_guard<mutex> guard(shard.lock);
+            for (int d = All; d < Name; d++)
+            {
+                const PostingList *list = usable[d] ? listFor(shard.index, d) : nullptr;
+                candidates[d] += list ? list->size() : 0;
+            }
+            if (usable[Name])
+                candidates[Name] += shard.index.nameTrie(shard.store).countPrefix(q.namePrefix);
+        }
+        candidates[Rooms] = roomFilter ? (size_t)(lastRoom - firstRoom + 1) : 0;
+        int driver = All;
+        for (int d = Emergency; d < DriverCount; d++)
+            if (usable[d] && candidates[d] < candidates[driver])
+                driver = d;
+
+        // Collect up to pageSize + 1 matches, the extra one only telling that there are more
+        vector<PatientInfo> found;
+        if (driver == Rooms)
+        {
+            vector<PatientId> ids;
+            for (int room = firstRoom; room <= lastRoom; room++)
+            {
+                PatientId id = occupants.at(room);
+                if (id > after)
+                    ids.push_back(id);
+            }
+            sort(ids.begin(), ids.end());
+            for (size_t k = 0; k < ids.size() && found.size() <= pageSize; k++)
+            {
+                const PatientCensus::Shard &shard = census.shardFor(ids[k]);
+                lock_guard<mutex> guard(shard.lock);
+                Patient p = shard.store.find(ids[k]);
+                if (p && matches(p))
+                    found.push_back(infoOf(p));
+            }
+        }
+        else
+        {
+            // Each shard contributes its first pageSize + 1 matches; the page is the lowest IDs
+            for (int i = 0; i < PATIENT_SHARDS; i++)
+            {
+                const PatientCensus::Shard &shard = census.shard(i);
+                lock_guard<mutex> guard(shard.lock);
+                size_t taken = 0;
+                auto take = [&](PatientId id)
+                {
+                    Patient p = shard.store.find(id);
+                    if (p && matches(p))
+                    {
+                        found.push_back(infoOf(p));
+                        taken++;
+                    }
+                    return taken <= pageSize;
+                };
+                if (driver == Name)
+                {
+                    vector<PatientId> ids;
+                    shard.index.nameTrie(shard.store).visitPrefix(q.namePrefix, [&](PatientId id)
+                                                       {
+                        if (id > after)
+                            ids.push_back(id); });
+                    sort(ids.begin(), ids.end());
+                    for (PatientId id : ids)
+                        if (!take(id))
+                            break;
+                }
+                else if (const PostingList *list = listFor(shard.index, driver))
+                    list->scan(after, take);
+            }
+            sort(found.begin(), found.end(), [](const PatientInfo &a, const PatientInfo &b)
+                 { return a.id < b.id; });
+        }
+
+        if (found.size() > pageSize)
+        {
+            found.resize(pageSize);
+            page.cursor = found.back().id;
+        }
+        page.patients = move(found);
+        return page;
+    }
+
+    int roomsAvailable() const { return rooms.available(); }
+    string doctorName(int doctorId) const { return doctors.nameOf(doctorId); }
+
+    // The severities accepted at admission, as set by the tariffs, joined for display
+    string severityChoices(const string &separator, const string &lastSeparator) const
+    {
+        const vector<string> &severities = diseaseIndex.allSeverities();
+        string joined;
+        for (size_t i = 0; i < severities.size(); i++)
+        {
+            if (i > 0)
+                joined += i + 1 == severities.size() ? lastSeparator : separator;
+            joined += severities[i];
+        }
+        return joined;
+    }
+
+    // Prompts for a severity; one without a tariff falls back to `preferred`, or to the first
+    // severity offered if the tariffs withdrew that one too
+    string readSeverity(const string &preferred)
+    {
+        string severity;
+        cout << "Enter severity (" << severityChoices("/", "/") << "): ";
+        cin >> severity;
+        if (diseaseIndex.severityCodeOf(severity) != -1)
+            return severity;
+
+        const vector<string> &severities = diseaseIndex.allSeverities();
+        string fallback = diseaseIndex.severityCodeOf(preferred) != -1 || severities.empty() ? preferred : severities[0];
+        cout << "Invalid severity! Using '" << fallback << "' as default.\n";
+        return fallback;
+    }
+
+    void addPatient()
+    {
+        string name, disease, severity;
+        int assignedDoctor;
+        cout << "Enter patient name: ";
+        cin.ignore();
+        getline(cin, name);
+
+        if (name.empty())
+        {
+            cout << "Invalid name!\n";
+            return;
+        }
+
+        showDiseases();
+        int choice;
+        cout << "Choose disease number: ";
+        cin >> choice;
+
+        if (choice < 1 || choice > diseaseIndex.size())
+        {
+            cout << "Invalid choice!\n";
+            return;
+        }
+        disease = diseaseIndex.all()[choice - 1];
+        severity = readSeverity("Mild");
+
+        showDoctorsForDisease(disease);
+        int recommended = recommendLeastCostDoctor(disease, severity);
+        if (recommended == -1)
+        {
+            cout << "All doctors for this disease are at capacity. Cannot admit patient.\n";
+            return;
+        }
+        cout << "\nRecommended doctor (least cost): " << doctors.nameOf(recommended) << "\n";
+        cout << "Do you want to accept this doctor? (y/n): ";
+        char ans;
+        cin >> ans;
+
+        if (ans == 'y' || ans == 'Y')
+        {
+            assignedDoctor = recommended;
+        }
+        else
+        {
+            cout << "Enter the name of doctor you want: ";
+            cin.ignore();
+            string doctorName;
+            getline(cin, doctorName);
+
+            assignedDoctor = doctors.findId(doctorName);
+            if (assignedDoctor == -1)
+            {
+                cout << "Doctor not found! Using recommended doctor.\n";
+                assignedDoctor = recommended;
+            }
+        }
+
+        // Holds stateLock like admitPatient, so a concurrent checkpoint captures the admission
+        // either in its snapshot or after its journal marker
+        Admission a;
+        {
+            shared_lock<shared_mutex> shared(stateLock);
+            a = admit(false, name, disease, severity, assignedDoctor);
+        }
+        compactIfNeeded();
+        if (a.status == AdmitStatus::NoRoom)
+        {
+            cout << " Sorry, no rooms are currently available. Cannot admit patient.\n";
+            return;
+        }
+        if (a.status != AdmitStatus::Admitted)
+        {
+            cout << "Cannot admit patient: " << describe(a.status) << ".\n";
+            return;
+        }
+        cout << "Patient added! ID: " << a.id << ", Assigned Doctor: " << doctors.nameOf(a.doctorId) << ", Room: " << a.roomNumber << "\n";
+    }
+
+    void addEmergencyPatient()
+    {
+        string name, disease, severity;
+        cout << "Enter emergency patient name: ";
+        cin.ignore();
+        getline(cin, name);
+
+        if (name.empty())
+        {
+            cout << "Invalid name!\n";
+            return;
+        }
+
+        showDiseases();
+        int choice;
+        cout << "Choose disease number: ";
+        cin >> choice;
+
+        if (choice < 1 || choice > diseaseIndex.size())
+        {
+            cout << "Invalid choice!\n";
+            return;
+        }
+        disease = diseaseIndex.all()[choice - 1];
+        severity = readSeverity("Moderate");
+
+        int recommended = recommendLeastCostDoctor(disease, severity);
+        if (recommended == -1)
+        {
+            cout << "All doctors for this disease are at capacity. Cannot admit patient.\n";
+            return;
+        }
+        cout << "\nRecommended doctor (least cost): " << doctors.nameOf(recommended) << "\n";
+
+        Admission a;
+        {
+            shared_lock<shared_mutex> shared(stateLock);
+            a = admit(true, name, disease, severity, recommended);
+        }
+        compactIfNeeded();
+        if (a.status == AdmitStatus::NoRoom)
+        {
+            cout << " Sorry, no rooms are currently available for this emergency patient.\n";
+            return;
+        }
+        if (a.status != AdmitStatus::Admitted)
+        {
+            cout << "Cannot admit emergency patient: " << describe(a.status) << ".\n";
+            return;
+        }
+        cout << "Emergency patient added! ID: " << a.id << ", Assigned Doctor: " << doctors.nameOf(a.doctorId) << ", Room: " << a.roomNumber << "\n";
+    }
+
+    // The listings read one snapshot for both the count and the rows, so they agree
+    void showAllPatients()
+    {
+        shared_ptr<const CensusSnapshot> view = snapshot();
+        if (view->size() == 0)
+        {
+            cout << "No patients in the system.\n";
+            return;
+        }
+
+        cout << "Patients List:\n";
+        view->forEach([](const CensusSnapshot::Entry &p)
+                      {
+            cout << p.getId() << ". ";
+            p.display(); });
+    }
+
+    void showAllEmergencyPatients()
+    {
+        shared_ptr<const CensusSnapshot> view = snapshot();
+        cout << "Emergency Patients List:\n";
+        view->forEach([](const CensusSnapshot::Entry &p)
+                      {
+            cout << p.getId() << ". ";
+            p.display(); },
+                      true);
+
+        if (view->emergencyCount() == 0)
+            cout << "No emergency patients in the system.\n";
+    }
+
+    void showAllDoctors()
+    {
+        cout << "Doctors List:\n";
+        for (auto d : doctors.all())
+            d->display();
+    }
+
+    void generateBill()
+    {
+        if (census.empty())
+        {
+            cout << "No patients in system.\n";
+            return;
+        }
+        cout << "Select patient number for bill:\n";
+        showAllPatients();
+        PatientId choice;
+        Bill bill;
+        if (!(cin >> choice) || !billFor(choice, bill))
+        {
+            cout << "Invalid choice!\n";
+            return;
+        }
+
+        cout << "\n===== BILL =====\n";
+        cout << "Patient Name: " << bill.patientName << "\n";
+        cout << "Disease: " << bill.disease << "\n";
+        cout << "Severity: " << bill.severity << "\n";
+        cout << "Assigned Doctor: " << bill.doctor << "\n";
+        cout << "Room Number: " << bill.roomNumber << "\n";
+        cout << "Total Cost: ₹" << bill.cost << "\n";
+        cout << "================\n";
+    }
+
+    void generateEmergencyBill()
+    {
+        shared_ptr<const CensusSnapshot> view = snapshot();
+        if (view->emergencyCount() == 0)
+        {
+            cout << "No emergency patients in system.\n";
+            return;
+        }
+
+        cout << "Select emergency patient number for bill:\n";
+        view->forEach([](const CensusSnapshot::Entry &p)
+                      {
+            cout << p.getId() << ". ";
+            p.display(); },
+                      true);
+
+        PatientId choice;
+        Bill bill;
+        if (!(cin >> choice) || !billFor(choice, bill) || !bill.emergency)
+        {
+            cout << "Invalid choice!\n";
+            return;
+        }
+
+        cout << "\n===== EMERGENCY BILL =====\n";
+        cout << "Patient Name: " << bill.patientName << "\n";
+        cout << "Disease: " << bill.disease << "\n";
+        cout << "Severity: " << bill.severity << "\n";
+        cout << "Assigned Doctor: " << bill.doctor << "\n";
+        cout << "Room Number: " << bill.roomNumber << "\n";
+        cout << "Total Emergency Cost: Rs." << bill.cost << "\n";
+        cout << "==========================\n";
+    }
+
+    void dischargePatient()
+    {
+        if (census.empty())
+        {
+            cout << "No patients to discharge.\n";
+            return;
+        }
+        cout << "Select patient number to discharge:\n";
+        showAllPatients();
+        PatientId choice;
+        Bill bill;
+        if (!(cin >> choice) || !billFor(choice, bill))
+        {
+            cout << "Invalid choice!\n";
+            return;
+        }
+
+        cout << "Patient " << bill.patientName << " discharged and room " << bill.roomNumber << " is now free.\n";
+        dischargeById(choice);
+    }
+
+    void dischargeEmergencyPatient()
+    {
+        shared_ptr<const CensusSnapshot> view = snapshot();
+        if (view->emergencyCount() == 0)
+        {
+            cout << "No emergency patients to discharge.\n";
+            return;
+        }
+
+        cout << "Select emergency patient number to discharge:\n";
+        view->forEach([](const CensusSnapshot::Entry &p)
+                      {
+            cout << p.getId() << ". ";
+            p.display(); },
+                      true);
+
+        PatientId choice;
+        Bill bill;
+        if (!(cin >> choice) || !billFor(choice, bill) || !bill.emergency)
+        {
+            cout << "Invalid choice!\n";
+            return;
+        }
+
+        cout << "Emergency Patient " << bill.patientName << " discharged and room " << bill.roomNumber << " is now free.\n";
+        dischargeById(choice);
+    }
+
+    // Writes a snapshot on this thread without printing anything. The snapshot absorbs every
+    // journaled change, so saving also compacts the journal.
+    bool save() { return checkpoint(false); }
+
+    // Queues a checkpoint on the background writer and returns at once
+    void requestCheckpoint()
+    {
+        lock_guard<mutex> guard(writerLock);
+        wakeWriter();
+    }
+
+    void saveToFile()
+    {
+        if (!save())
+        {
+            cout << "Error saving file.\n";
+            return;
+        }
+        cout << "Data saved successfully.\n";
+    }
+
+    void loadFromFile()
+    {
+        HOSPITAL_METRIC(Load);
+        lock_guard<mutex> guard(checkpointLock);
+        unique_lock<shared_mutex> exclusive(stateLock);
+        if (config.format == SnapshotFormat::Binary)
+        {
+            switch (loadBinary(config.snapshotFile))
+            {
+            case LoadResult::Loaded:
+                cout << "Data loaded successfully.\n";
+                return;
+            case LoadResult::Corrupt:
+                HOSPITAL_METRIC_FAIL();
+                cout << "Snapshot " << config.snapshotFile << " is corrupt or from an unsupported version. Starting fresh.\n";
+                return;
+            case LoadResult::Missing:
+                break; // fall back to importing an older text save
+            }
+        }
+
+        if (!loadText(config.dataFile))
+        {
+            cout << "No previous data found. Starting fresh.\n";
+            return;
+        }
+        cout << "Data loaded successfully.\n";
+    }
+
+    // Replays changes journaled since the loaded snapshot and keeps the journal open for appends
+    void openJournal()
+    {
+        if (!config.journaling)
+            return;
+        unique_lock<shared_mutex> exclusive(stateLock);
+        lock_guard<mutex> guard(journalLock);
+        vector<JournalEntry> pending;
+        if (!journal.open(config.journalFile, generation, pending))
+        {
+            cout << "Warning: cannot open journal " << config.journalFile << "; changes are only kept on save.\n";
+            journal.close();
+            return;
+        }
+        if (!pending.empty())
+        {
+            replayJournal(pending);
+            cout << "Recovered " << pending.size() << " journaled change(s).\n";
+        }
+    }
+
+    void exportToText()
+    {
+        lock_guard<mutex> guard(checkpointLock);
+        if (!saveText(config.dataFile, capture(false)))
+        {
+            cout << "Error saving file.\n";
+            return;
+        }
+        cout << "Data exported to " << config.dataFile << ".\n";
+    }
+
+    void importFromText()
+    {
+        lock_guard<mutex> guard(checkpointLock);
+        lock_guard<mutex> snapshotGuard(snapshotLock);
+        unique_lock<shared_mutex> exclusive(stateLock);
+        if (!loadText(config.dataFile))
+        {
+            cout << "No text data found in " << config.dataFile << ".\n";
+            return;
+        }
+        // The imported state replaces everything journaled so far; nothing may be admitted
+        // on top of it until its snapshot is written
+        Checkpoint cp;
+        SnapshotCut cut;
+        shared_ptr<const CensusSnapshot> previous;
+        captureLocked(cp, cut, previous, true);
+        finishCapture(cp, cut, previous);
+        finishCheckpoint(cp, writeCheckpoint(cp));
+        cout << "Data imported from " << config.dataFile << ".\n";
+    }
+
+    void setSnapshotFormat(SnapshotFormat f) { config.format = f; }
+    SnapshotFormat getSnapshotFormat() const { return config.format; }
+
+    void summaryReport()
+    {
+        cout << "\n===== HOSPITAL SUMMARY REPORT =====\n";
+        Summary summary = summarize();
+        for (auto &d : summary.doctors)
+        {
+            cout << "Doctor: " << d.name << ", Patients Treated: " << d.patients
+                 << ", Revenue: Rs." << d.revenue << "\n";
+        }
+
+        cout << "Total Hospital Revenue: ₹" << summary.totalRevenue << "\n";
+        cout << "Patients: " << summary.patients << " (Emergency: " << summary.emergencies << ")\n";
+        cout << "By Disease:\n";
+        for (auto &d : summary.byDisease)
+            cout << "  " << d.first << ": " << d.second << "\n";
+        cout << "By Severity:\n";
+        for (auto &sev : summary.bySeverity)
+            cout << "  " << sev.first << ": " << sev.second << "\n";
+        cout << "===================================\n";
+    }
+
+#ifndef HOSPITAL_NO_METRICS
+    // Operation metrics from every thread plus occupancy gauges, in Prometheus text format
+    void writeMetrics(ostream &out) const
+    {
+        shared_lock<shared_mutex> shared(stateLock);
+        auto label = [](const string &value)
+        {
+            string escaped;
+            for (char c : value)
+            {
+                if (c == '\\' || c == '"')
+                    escaped += '\\';
+                escaped += c == '\n' ? ' ' : c;
+            }
+            return escaped;
+        };
+        auto header = [&out](const char *name, const char *type, const char *help)
+        {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+        };
+
+        vector<MetricTotals> totals = Metrics::instance().totals();
+        header("hospital_operations_total", "counter", "Operations completed, including failed ones.");
+        for (int op = 0; op < (int)MetricOp::Count; op++)
+            out << "hospital_operations_total{op=\"" << metricName((MetricOp)op) << "\"} " << totals[op].count << "\n";
+        header("hospital_operation_failures_total", "counter", "Operations that were rejected or failed.");
+        for (int op = 0; op < (int)MetricOp::Count; op++)
+            out << "hospital_operation_failures_total{op=\"" << metricName((MetricOp)op) << "\"} " << totals[op].failures << "\n";
+        header("hospital_operation_duration_seconds", "histogram", "Operation latency.");
+        for (int op = 0; op < (int)MetricOp::Count; op++)
+        {
+            const MetricTotals &t = totals[op];
+            string name = metricName((MetricOp)op);
+            uint64_t cumulative = 0;
+            for (int b = 0; b < METRIC_BUCKETS; b++)
+            {
+                cumulative += t.buckets[b];
+                out << "hospital_operation_duration_seconds_bucket{op=\"" << name << "\",le=\"" << Metrics::bucketBoundSeconds(b) << "\"} " << cumulative << "\n";
+            }
+            out << "hospital_operation_duration_seconds_bucket{op=\"" << name << "\",le=\"+Inf\"} " << t.count << "\n";
+            out << "hospital_operation_duration_seconds_sum{op=\"" << name << "\"} " << t.totalNs / 1e9 << "\n";
+            out << "hospital_operation_duration_seconds_count{op=\"" << name << "\"} " << t.count << "\n";
+        }
+
+        header("hospital_rooms", "gauge", "Rooms in the hospital.");
+        out << "hospital_rooms " << rooms.size() << "\n";
+        header("hospital_rooms_occupied", "gauge", "Rooms with a patient in them.");
+        out << "hospital_rooms_occupied " << rooms.size() - rooms.available() << "\n";
+        header("hospital_patients", "gauge", "Admitted patients.");
+        out << "hospital_patients " << census.size() << "\n";
+        header("hospital_emergency_patients", "gauge", "Admitted emergency patients.");
+        out << "hospital_emergency_patients " << census.emergencyCount() << "\n";
+        header("hospital_doctor_patients", "gauge", "Admitted patients by assigned doctor.");
+        for (int id = 0; id < doctors.size(); id++)
+            out << "hospital_doctor_patients{doctor=\"" << label(doctors.get(id)->getName()) << "\"} " << doctors.get(id)->getPatientCount() << "\n";
+    }
+
+    // Writes to a temporary file renamed over `path`, so a scraper never reads a partial file
+    bool exportMetrics(const string &path) const
+    {
+        string temp = path + ".tmp";
+        {
+            ofstream out(temp, ios::trunc);
+            if (!out)
+                return false;
+            writeMetrics(out);
+            if (!out.flush())
+                return false;
+        }
+        return rename(temp.c_str(), path.c_str()) == 0;
+    }
+
+    const string &metricsFile() const { return config.metricsFile; }
+
+    void showMetrics()
+    {
+        writeMetrics(cout);
+        if (exportMetrics(config.metricsFile))
+            cout << "Metrics written to " << config.metricsFile << ".\n";
+        else
+            cout << "Error writing " << config.metricsFile << ".\n";
+    }
+#endif
+};
+
+// Splits a batch command line into words; double quotes group words containing spaces
+vector<string> splitCommand(const string &line)
+{
+    vector<string> words;
+    string word;
+    bool quoted = false, inWord = false;
+    for (char c : line)
+    {
+        if (c == '"')
+        {
+            quoted = !quoted;
+            inWord = true;
+        }
+        else if (isspace((unsigned char)c) && !quoted)
+        {
+            if (inWord)
+                words.push_back(word);
+            word.clear();
+            inWord = false;
+        }
+        else
+        {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord)
+        words.push_back(word);
+    return words;
+}
+
+// Reads the key=value filters of a find command from words[first..]. `after` and `limit`
+// page through the results; returns false with a message on an unknown or malformed key.
+bool parseQuery(const vector<string> &words, size_t first, PatientQuery &q, PatientId &after, size_t &limit, string &error)
+{
+    for (size_t i = first; i < words.size(); i++)
+    {
+        size_t eq = words[i].find('=');
+        string key = words[i].substr(0, eq), value = eq == string::npos ? "" : words[i].substr(eq + 1);
+        bool ok = true;
+        if (eq == string::npos)
+            ok = false;
+        else if (key == "disease")
+            q.disease = value;
+        else if (key == "severity")
+            q.severity = value;
+        else if (key == "doctor")
+            q.doctor = value;
+        else if (key == "name")
+            q.namePrefix = value;
+        else if (key == "rooms")
+        {
+            size_t dash = value.find('-');
+            q.firstRoom = parseInt(string_view(value).substr(0, dash), 0, &ok);
+            q.lastRoom = dash == string::npos ? q.firstRoom : parseInt(string_view(value).substr(dash + 1), 0, &ok);
+            ok = ok && q.firstRoom > 0 && q.lastRoom >= q.firstRoom;
+        }
+        else if (key == "emergency")
+        {
+            q.emergency = value == "1" ? 1 : 0;
+            ok = value == "0" || value == "1";
+        }
+        else if (key == "after")
+            after = (PatientId)max(0, parseInt(value, 0, &ok));
+        else if (key == "limit")
+        {
+            int n = parseInt(value, 0, &ok);
+            limit = (size_t)max(1, n);
+            ok = ok && n > 0;
+        }
+        else
+            ok = false;
+        if (!ok)
+        {
+            error = "bad filter \"" + words[i] + "\"; use disease= severity= doctor= name= rooms=A-B emergency=0|1 after=ID limit=N";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Menu option: reads one line of filters and shows the matches a page at a time
+void findPatients(Hospital &h)
+{
+    cout << "Filters (disease= severity= doctor= name= rooms=A-B emergency=0|1, blank for all): ";
+    string line;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    getline(cin, line);
+
+    PatientQuery q;
+    PatientId after = 0;
+    size_t limit = 20;
+    string error;
+    if (!parseQuery(splitCommand(line), 0, q, after, limit, error))
+    {
+        cout << error << "\n";
+        return;
+    }
+    size_t shown = 0;
+    while (true)
+    {
+        PatientPage page = h.queryPatients(q, after, limit);
+        for (const PatientInfo &p : page.patients)
+        {
+            cout << p.id << ". ";
+            p.display();
+        }
+        shown += page.patients.size();
+        if (page.cursor == 0)
+            break;
+        cout << "More matches; press Enter for the next page or q to stop: ";
+        if (!getline(cin, line) || line == "q")
+            break;
+        after = page.cursor;
+    }
+    if (shown == 0)
+        cout << "No matching patients.\n";
+}
+
+// Menu flow for reloading the tariff file; a blank path reads the current one again
+void reloadTariffFile(Hospital &h)
+{
+    string current = h.tariffFile();
+    cout << "Tariff file" << (current.empty() ? "" : " [" + current + "]") << ": ";
+    string path;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    getline(cin, path);
+    if (path.empty())
+        path = current;
+    if (path.empty())
+    {
+        cout << "No tariff file given.\n";
+        return;
+    }
+
+    TariffReload result;
+    string error;
+    if (!h.reloadTariffs(path, result, error))
+    {
+        cout << "Tariffs not changed: " << error << "\n";
+        return;
+    }
+    cout << "Tariffs reloaded from " << path << ": " << result.diseases << " disease(s), " << result.severities << " severity(ies), "
+         << result.doctors << " surcharge(s)" << (result.emergency ? " and the emergency factor" : "") << " changed; "
+         << result.rebilled << " of " << result.checked << " affected patient(s) rebilled.\n";
+}
+
+// Non-interactive command mode for bulk intake. Reads one command per line and writes one
+// result line per command (several for list/report); output is buffered and flushed in blocks.
+//   admit <name> <disease> <severity> [doctor]
+//   admit-emergency <name> <disease> <severity> [doctor]
+//   discharge <patient id>
+//   bill <patient id>
+//   bill-all [emergency]        (totals every bill, or only the emergency patients')
+//   list
+//   list-emergency
+//   find [disease=] [severity=] [doctor=] [name=prefix] [rooms=A-B] [emergency=0|1] [after=id] [limit=n]
+//   report
+//   verify                      (checks the running totals against a full recount)
+//   save
+//   checkpoint                  (queues a background save and returns at once)
+//   reload-tariffs [file]       (reads the tariff file again, or a new one)
+//   wards
+//   metrics [file]              (prints the metrics and writes them to the file)
+// Patients are identified by the stable ID printed on admission and in listings. Blank lines and '#' comments are
+// skipped. Returns 0 if every command succeeded, 1 otherwise.
+int runBatch(Hospital &h, istream &in, ostream &out)
+{
+    string buffer;
+    auto flush = [&]()
+    {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    };
+    auto quote = [](const string &s) { return "\"" + s + "\""; };
+
+    int errors = 0;
+    int lineNo = 0;
+    string line;
+    while (getline(in, line))
+    {
+        lineNo++;
+        vector<string> args = splitCommand(line);
+        if (args.empty() || args[0][0] == '#')
+            continue;
+
+        const string &cmd = args[0];
+        string error;
+        if (cmd == "admit" || cmd == "admit-emergency")
+        {
+            if (args.size() < 4 || args.size() > 5)
+                error = "usage: " + cmd + " <name> <disease> <severity> [doctor]";
+            else
+            {
+                Admission a = h.admitPatient(args[1], args[2], args[3], args.size() == 5 ? args[4] : "", cmd == "admit-emergency");
+                if (a.status == AdmitStatus::InvalidSeverity)
+                    error = "severity must be " + h.severityChoices(", ", " or ");
+                else if (a.status != AdmitStatus::Admitted)
+                    error = describe(a.status);
+                else
+                    buffer += "ok " + cmd + " " + to_string(a.id) + " room=" + to_string(a.roomNumber) +
+                              " doctor=" + quote(h.doctorName(a.doctorId)) + "\n";
+            }
+        }
+        else if (cmd == "discharge" || cmd == "bill")
+        {
+            PatientId id = args.size() == 2 ? (PatientId)max(0, safe_stoi(args[1], 0)) : 0;
+            Bill bill;
+            if (args.size() != 2)
+                error = "usage: " + cmd + " <patient id>";
+            else if (cmd == "discharge" ? !h.dischargeById(id) : !h.billFor(id, bill))
+                error = "no patient with id " + args[1];
+            else if (cmd == "discharge")
+            {
+                buffer += "ok discharge " + to_string(id) + "\n";
+            }
+            else
+            {
+                ostringstream cost;
+                cost << bill.cost;
+                buffer += "ok bill " + to_string(id) + " " + quote(bill.patientName) + " cost=" + cost.str() + "\n";
+            }
+        }
+        else if (cmd == "list" || cmd == "list-emergency")
+        {
+            size_t count = 0;
+            h.forEachPatient([&](const CensusSnapshot::Entry &p)
+                             {
+                buffer += "patient " + to_string(p.getId()) + " " + quote(p.getName()) + " " + quote(p.getDisease()) + " " +
+                          p.getSeverity() + " " + quote(p.getAssignedDoctor()) + " room=" + to_string(p.getRoomNumber()) +
+                          " emergency=" + (p.isEmergency() ? "1" : "0") + "\n";
+                count++; },
+                             cmd == "list-emergency");
+            buffer += "ok " + cmd + " " + to_string(count) + "\n";
+        }
+        else if (cmd == "find")
+        {
+            // Pages of matches in ID order; "next=" is the after= value for the following page
+            PatientQuery q;
+            PatientId after = 0;
+            size_t limit = 50;
+            if (parseQuery(args, 1, q, after, limit, error))
+            {
+                PatientPage page = h.queryPatients(q, after, limit);
+                for (const PatientInfo &p : page.patients)
+                    buffer += "patient " + to_string(p.id) + " " + quote(p.name) + " " + quote(p.disease) + " " + p.severity + " " +
+                              quote(p.doctor) + " room=" + to_string(p.roomNumber) + " emergency=" + (p.emergency ? "1" : "0") + "\n";
+                buffer += "ok find " + to_string(page.patients.size()) + " next=" + to_string(page.cursor) + "\n";
+            }
+        }
+        else if (cmd == "bill-all")
+        {
+            // Totals only; "bill-all emergency" restricts the pass to emergency patients
+            vector<double> bills;
+            ostringstream total;
+            size_t count = 0;
+            if (args.size() > 1 && args[1] == "emergency")
+            {
+                vector<PatientId> ids;
+                h.forEachPatient([&ids](const CensusSnapshot::Entry &p)
+                                 { ids.push_back(p.getId()); },
+                                 true);
+                total << h.billPatients(ids, bills);
+                count = ids.size();
+            }
+            else if (args.size() > 1)
+            {
+                error = "usage: bill-all [emergency]";
+            }
+            else
+            {
+                total << h.billAll();
+                count = h.patientCount();
+            }
+            if (error.empty())
+                buffer += "ok bill-all patients=" + to_string(count) + " total=" + total.str() + "\n";
+        }
+        else if (cmd == "report")
+        {
+            Summary summary = h.summarize();
+            ostringstream report;
+            for (auto &d : summary.doctors)
+                report << "doctor " << quote(d.name) << " patients=" << d.patients << " revenue=" << d.revenue << "\n";
+            for (auto &d : summary.byDisease)
+                report << "disease " << quote(d.first) << " patients=" << d.second << "\n";
+            for (auto &sev : summary.bySeverity)
+                report << "severity " << quote(sev.first) << " patients=" << sev.second << "\n";
+            report << "ok report patients=" << summary.patients << " emergency=" << summary.emergencies
+                   << " revenue=" << summary.totalRevenue << "\n";
+            buffer += report.str();
+        }
+        else if (cmd == "verify")
+        {
+            ostringstream problems;
+            if (h.verifyAggregates(problems))
+                buffer += "ok verify\n";
+            else
+            {
+                buffer += problems.str();
+                error = "running totals disagree with the census";
+            }
+        }
+        else if (cmd == "save")
+        {
+            if (h.save())
+                buffer += "ok save\n";
+            else
+                error = "cannot write snapshot";
+        }
+        else if (cmd == "checkpoint")
+        {
+            h.requestCheckpoint();
+            buffer += "ok checkpoint queued\n";
+        }
+        else if (cmd == "reload-tariffs")
+        {
+            string path = args.size() > 1 ? args[1] : h.tariffFile();
+            TariffReload result;
+            if (path.empty())
+                error = "no tariff file given";
+            else if (h.reloadTariffs(path, result, error))
+                buffer += "ok reload-tariffs diseases=" + to_string(result.diseases) + " severities=" + to_string(result.severities) +
+                          " doctors=" + to_string(result.doctors) + " emergency=" + (result.emergency ? "1" : "0") +
+                          " checked=" + to_string(result.checked) + " rebilled=" + to_string(result.rebilled) + "\n";
+        }
+        else if (cmd == "wards")
+        {
+            ostringstream report;
+            int roomTotal = 0, freeTotal = 0;
+            vector<WardOccupancy> wards = h.wardOccupancy();
+            for (auto &w : wards)
+            {
+                report << "ward " << quote(w.name) << " floor=" << w.floor << " type=" << roomTypeName(w.type) << " emergency=" << (w.emergency ? 1 : 0)
+                       << " rooms=" << w.rooms << " free=" << w.free << " doctors=" << w.doctors << "\n";
+                roomTotal += w.rooms;
+                freeTotal += w.free;
+            }
+            report << "ok wards count=" << wards.size() << " rooms=" << roomTotal << " free=" << freeTotal << "\n";
+            buffer += report.str();
+        }
+        else if (cmd == "metrics")
+        {
+#ifndef HOSPITAL_NO_METRICS
+            string path = args.size() > 1 ? args[1] : h.metricsFile();
+            ostringstream metrics;
+            h.writeMetrics(metrics);
+            buffer += metrics.str();
+            if (h.exportMetrics(path))
+                buffer += "ok metrics file=" + quote(path) + "\n";
+            else
+                error = "cannot write " + quote(path);
+#else
+            error = "metrics are compiled out (HOSPITAL_NO_METRICS)";
+#endif
+        }
+        else
+        {
+            error = "unknown command " + quote(cmd);
+        }
+
+        if (!error.empty())
+        {
+            errors++;
+            buffer += "error " + to_string(lineNo) + ": " + error + "\n";
+        }
+        if (buffer.size() >= 64 * 1024)
+            flush();
+    }
+    flush();
+    out.flush();
+    return errors == 0 ? 0 : 1;
+}
+
+// Microbenchmark for RoomAllocator against the original linear vector<bool> scan.
+// Both run the same near-full churn: free a random room, then admit into the lowest free room.
+int benchmarkRooms()
+{
+    using Clock = chrono::steady_clock;
+    cout << "rooms,method,ops,ns_per_op,checksum\n";
+    for (int n : {100, 10000, 1000000})
+    {
+        int ops = (int)min(1000000LL, 1000000000LL / n); // keep the O(n) scan bounded
+
+        mt19937 rng(42);
+        vector<int> victims(ops);
+        for (auto &v : victims)
+            v = (int)(rng() % n);
+
+        // Original approach: linear scan from room 0 on every admission
+        vector<bool> scanRooms(n, true);
+        long long scanSum = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < ops; i++)
+        {
+            scanRooms[victims[i]] = false;
+            int room = -1;
+            for (int r = 0; r < n; ++r)
+            {
+                if (!scanRooms[r])
+                {
+                    room = r;
+                    break;
+                }
+            }
+            scanRooms[room] = true;
+            scanSum += room;
+        }
+        double scanNs = chrono::duration<double, nano>(Clock::now() - start).count() / ops;
+
+        RoomAllocator allocator(n);
+        allocator.reserveBulk(n);
+        long long allocSum = 0;
+        start = Clock::now();
+        for (int i = 0; i < ops; i++)
+        {
+            allocator.release(victims[i]);
+            allocSum += allocator.allocate();
+        }
+        double allocNs = chrono::duration<double, nano>(Clock::now() - start).count() / ops;
+
+        cout << n << ",scan," << ops << "," << scanNs << "," << scanSum << "\n";
+        cout << n << ",bitmap," << ops << "," << allocNs << "," << allocSum << "\n";
+        if (scanSum != allocSum)
+            cout << "MISMATCH: allocators chose different rooms at " << n << " rooms\n";
+    }
+    return 0;
+}
+
+// Room placement at high occupancy. A synthetic hospital of 8 floors with 4 wards each (two
+// general, one ICU and one isolation ward; the first two floors' A and ICU wards take
+// emergencies and have no doctors of their own) is filled to the target occupancy and then
+// churned: each operation discharges a random patient and admits one whose doctor is based on
+// a random other ward, 1 in 10 of them an emergency. "flat" is the lowest-free-room allocator
+// used before wards, "ward" is WardTopology::place. Besides the cost of a discharge plus an
+// admission it reports how often other patients landed on their doctor's ward and on its
+// floor, and how often emergencies landed on an emergency ward.
+int benchmarkWards()
+{
+    using Clock = chrono::steady_clock;
+    const int floors = 8, perFloor = 4, wardCount = floors * perFloor, ops = 1000000;
+    cout << "rooms,occupancy,method,ops,ns_per_op,home_ward_pct,same_floor_pct,emergency_ward_pct\n";
+    bool ok = true;
+    for (int n : {1024, 65536, 1048576})
+    {
+        vector<WardSpec> specs;
+        for (int f = 1; f <= floors; f++)
+        {
+            for (int k = 0; k < perFloor; k++)
+            {
+                WardSpec ward;
+                ward.name = "F" + to_string(f) + "-" + "ABCD"[k];
+                ward.floor = f;
+                ward.type = k == 2 ? RoomType::ICU : k == 3 ? RoomType::Isolation : RoomType::General;
+                ward.rooms = n / wardCount;
+                ward.emergency = f <= 2 && (k == 0 || k == 2);
+                specs.push_back(ward);
+            }
+        }
+        WardTopology topology(specs);
+        vector<int> doctorWards;
+        for (int w = 0; w < wardCount; w++)
+            if (!specs[w].emergency)
+                doctorWards.push_back(w);
+
+        for (double occupancy : {0.95, 0.99})
+        {
+            mt19937 rng(7);
+            vector<uint32_t> victims(ops);
+            vector<int> homes(ops);
+            vector<bool> emergencies(ops);
+            for (int i = 0; i < ops; i++)
+            {
+                victims[i] = rng();
+                homes[i] = doctorWards[rng() % doctorWards.size()];
+                emergencies[i] = rng() % 10 == 0;
+            }
+
+            for (const char *method : {"flat", "ward"})
+            {
+                bool flat = method[0] == 'f';
+                RoomAllocator rooms(topology.rooms());
+                rooms.partition(topology.roomStarts());
+                auto admit = [&](bool emergency, int home)
+                { return flat ? rooms.allocate() : topology.place(rooms, emergency, home); };
+
+                vector<int> held;
+                size_t target = (size_t)(occupancy * topology.rooms());
+                for (size_t i = 0; held.size() < target; i++)
+                    held.push_back(admit(emergencies[i % ops], homes[i % ops]));
+
+                vector<int> placed(ops);
+                auto start = Clock::now();
+                for (int i = 0; i < ops; i++)
+                {
+                    size_t k = victims[i] % held.size();
+                    rooms.release(held[k]);
+                    held[k] = placed[i] = admit(emergencies[i], homes[i]);
+                }
+                double ns = chrono::duration<double, nano>(Clock::now() - start).count() / ops;
+
+                long long home = 0, floor = 0, emergency = 0, emergencyWard = 0;
+                for (int i = 0; i < ops; i++)
+                {
+                    int w = topology.wardOf(placed[i]);
+                    if (emergencies[i])
+                    {
+                        emergency++;
+                        emergencyWard += w >= 0 && topology.ward(w).emergency;
+                    }
+                    else
+                    {
+                        home += w == homes[i];
+                        floor += w >= 0 && topology.ward(w).floor == topology.ward(homes[i]).floor;
+                    }
+                }
+                double others = max(1LL, ops - emergency);
+                cout << topology.rooms() << "," << occupancy << "," << method << "," << ops << "," << ns << ","
+                     << 100.0 * home / others << "," << 100.0 * floor / others << "," << 100.0 * emergencyWard / max(1LL, emergency) << "\n";
+
+                vector<int> sorted = held;
+                sort(sorted.begin(), sorted.end());
+                if (sorted.front() < 0 || adjacent_find(sorted.begin(), sorted.end()) != sorted.end() ||
+                    rooms.available() != topology.rooms() - (int)held.size())
+                {
+                    cout << "MISMATCH: " << method << " gave a room out twice or lost one at " << topology.rooms() << " rooms\n";
+                    ok = false;
+                }
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+// Bulk billing against the per-patient paths it replaces, on a synthetic census: "map" is
+// the original calculateBill (two string-keyed map lookups per patient), "view" is one
+// Patient::calculateBill call per patient, "bulk" is BillingEngine on 1 and on all cores.
+// Every method must produce bit-identical bills.
+int benchmarkBilling()
+{
+    using Clock = chrono::steady_clock;
+    map<string, double> diseaseCost = {{"Flu", 1000}, {"Cold", 500}, {"Fever", 800}, {"Diabetes", 4000}, {"Asthma", 2500}, {"Heart Disease", 5000}};
+    map<string, double> severityMultiplier = {{"Mild", 1.0}, {"Moderate", 1.5}, {"Severe", 2.0}};
+    const char *diseases[] = {"Flu", "Cold", "Fever", "Diabetes", "Asthma", "Heart Disease", "Rare Disorder"}; // the last has no tariff
+    const char *severities[] = {"Mild", "Moderate", "Severe", "Critical"};                                   // so has the last
+
+    DoctorRegistry registry;
+    for (int i = 0; i < 10; i++)
+        registry.add("Dr. " + to_string(i), {diseases[i % 6]}, 700 + 100 * i);
+
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    cout << "patients,method,threads,ns_per_patient,total\n";
+    int failures = 0;
+    for (int n : {10000, 1000000, 10000000})
+    {
+        PatientStore store(&registry);
+        store.reserve(n, (size_t)n * 8);
+        mt19937 rng(7);
+        for (int i = 0; i < n; i++)
+            store.add(0, rng() % 10 == 0, "P" + to_string(i), diseases[rng() % 7], severities[rng() % 4], (int)(rng() % 11) - 1, i + 1);
+        // Leave some holes, as discharges do
+        for (int i = 0; i < n / 20; i++)
+            store.remove((PatientId)(rng() % n + 1));
+
+        TariffTable tariffs;
+        for (size_t code = 0; code < store.diseaseTable().size(); code++)
+        {
+            auto it = diseaseCost.find(store.diseaseTable().nameOf((uint16_t)code));
+            tariffs.diseaseCost.push_back(it == diseaseCost.end() ? -1 : it->second);
+        }
+        for (size_t code = 0; code < store.severityTable().size(); code++)
+        {
+            auto it = severityMultiplier.find(store.severityTable().nameOf((uint16_t)code));
+            tariffs.severityMultiplier.push_back(it == severityMultiplier.end() ? -1 : it->second);
+        }
+        BillingEngine engine;
+        engine.prepare(tariffs, registry);
+
+        int reps = max(1, 10000000 / n);
+        vector<double> expected(store.rows(), 0), bills;
+        auto run = [&](const char *method, unsigned threads, auto pass)
+        {
+            double total = 0;
+            auto start = Clock::now();
+            for (int r = 0; r < reps; r++)
+                total = pass();
+            double ns = chrono::duration<double, nano>(Clock::now() - start).count() / reps / store.size();
+            cout << n << "," << method << "," << threads << "," << ns << "," << fixed << total << defaultfloat << "\n";
+            for (size_t row = 0; row < store.rows(); row++)
+            {
+                if (bills[row] != expected[row])
+                {
+                    cout << "MISMATCH: " << method << " row " << row << " billed " << bills[row] << ", expected " << expected[row] << "\n";
+                    failures++;
+                    break;
+                }
+            }
+        };
+
+        // The original per-patient bill, which defines the expected results
+        bills.assign(store.rows(), 0);
+        run("map", 1, [&]()
+            {
+                double total = 0;
+                for (uint32_t row = 0; row < store.rows(); row++)
+                {
+                    if (!store.id(row))
+                        continue;
+                    auto diseaseIt = diseaseCost.find(store.disease(row));
+                    auto severityIt = severityMultiplier.find(store.severity(row));
+                    double bill = 500.0;
+                    if (diseaseIt != diseaseCost.end() && severityIt != severityMultiplier.end())
+                        bill = diseaseIt->second * severityIt->second + registry.surchargeOf(store.doctorId(row));
+                    if (store.isEmergency(row))
+                        bill *= 1.5;
+                    expected[row] = bills[row] = bill;
+                    total += bill;
+                }
+                return total; });
+
+        run("view", 1, [&]()
+            {
+                double total = 0;
+                for (uint32_t row = 0; row < store.rows(); row++)
+                {
+                    if (!store.id(row))
+                        continue;
+                    Patient p(&store, row);
+                    bills[row] = p.calculateBill(tariffs, registry.surchargeOf(p.getDoctorId()));
+                    total += bills[row];
+                }
+                return total; });
+
+        run("bulk", 1, [&]()
+            { return engine.billAll(store, bills, 1); });
+        run("bulk", cores, [&]()
+            { return engine.billAll(store, bills, cores); });
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// calculateBill tariff lookup, before and after the compile-time tables: "map" is the
+// original pair of std::map<string, double> lookups, "perfect_hash" resolves the same names
+// through the constexpr perfect hashes, and "coded" is what Patient::calculateBill does now,
+// indexing TariffTable arrays by the codes stored with each patient.
+int benchmarkTariff()
+{
+    using Clock = chrono::steady_clock;
+    TariffSchedule schedule;
+    map<string, double> diseaseCost, severityMultiplier;
+    for (auto &e : BUILTIN_DISEASE_COSTS)
+        diseaseCost[string(e.name)] = e.value;
+    for (auto &e : BUILTIN_SEVERITY_MULTIPLIERS)
+        severityMultiplier[string(e.name)] = e.value;
+
+    // Every built-in name plus one unknown of each kind, which must bill the 500 default
+    vector<string> diseaseNames, severityNames;
+    for (auto &e : BUILTIN_DISEASE_COSTS)
+        diseaseNames.emplace_back(e.name);
+    for (auto &e : BUILTIN_SEVERITY_MULTIPLIERS)
+        severityNames.emplace_back(e.name);
+    diseaseNames.push_back("Rare Disorder");
+    severityNames.push_back("Critical");
+
+    TariffTable tariffs;
+    for (auto &d : diseaseNames)
+        tariffs.diseaseCost.push_back(schedule.diseaseCost.valueOf(d));
+    for (auto &s : severityNames)
+        tariffs.severityMultiplier.push_back(schedule.severityMultiplier.valueOf(s));
+
+    const int n = 1000000;
+    mt19937 rng(11);
+    vector<uint16_t> diseases(n), severities(n);
+    vector<double> surcharges(n);
+    for (int i = 0; i < n; i++)
+    {
+        diseases[i] = (uint16_t)(rng() % diseaseNames.size());
+        severities[i] = (uint16_t)(rng() % severityNames.size());
+        surcharges[i] = 700 + 100 * (rng() % 10);
+    }
+
+    cout << "method,bills,ns_per_bill,total\n";
+    double expected = 0;
+    int failures = 0;
+    auto run = [&](const char *method, auto bill)
+    {
+        double total = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < n; i++)
+            total += bill(i);
+        double ns = chrono::duration<double, nano>(Clock::now() - start).count() / n;
+        cout << method << "," << n << "," << ns << "," << fixed << total << defaultfloat << "\n";
+        if (expected == 0)
+            expected = total;
+        else if (total != expected)
+        {
+            cout << "MISMATCH: " << method << "\n";
+            failures++;
+        }
+    };
+
+    run("map", [&](int i)
+        {
+            auto diseaseIt = diseaseCost.find(diseaseNames[diseases[i]]);
+            auto severityIt = severityMultiplier.find(severityNames[severities[i]]);
+            if (diseaseIt == diseaseCost.end() || severityIt == severityMultiplier.end())
+                return 500.0;
+            return diseaseIt->second * severityIt->second + surcharges[i]; });
+    run("perfect_hash", [&](int i)
+        {
+            double cost = schedule.diseaseCost.valueOf(diseaseNames[diseases[i]]);
+            double multiplier = schedule.severityMultiplier.valueOf(severityNames[severities[i]]);
+            if (cost < 0 || multiplier < 0)
+                return 500.0;
+            return cost * multiplier + surcharges[i]; });
+    run("coded", [&](int i)
+        { return tariffs.bill(diseases[i], severities[i], surcharges[i], false); });
+    return failures == 0 ? 0 : 1;
+}
+
+// ---- Workload benchmark (--bench-workload) ----
+// Drives a Hospital through synthetic scenarios and reports per-operation throughput and
+// latency percentiles as CSV or JSON lines, so runs can be diffed between versions.
+
+// Latency samples for one operation type within a scenario
+class LatencyRecorder
+{
+private:
+    vector<uint64_t> samples; // nanoseconds
+    uint64_t totalNs = 0;
+
+public:
+    void add(uint64_t ns)
+    {
+        samples.push_back(ns);
+        totalNs += ns;
+    }
+
+    size_t count() const { return samples.size(); }
+    double seconds() const { return totalNs / 1e9; }
+
+    // Nearest-rank percentile, q in [0, 1]; sorts the samples on first use
+    uint64_t percentile(double q)
+    {
+        if (samples.empty())
+            return 0;
+        if (!is_sorted(samples.begin(), samples.end()))
+            sort(samples.begin(), samples.end());
+        size_t rank = (size_t)ceil(q * samples.size());
+        return samples[min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+};
+
+struct WorkloadOptions
+{
+    int census = 100000;     // patients admitted in steady state
+    int rooms = 0;           // 0: census plus 10% headroom for surges
+    int doctors = 10;        // 10 is the built-in roster; any other count is synthetic
+    int ops = 200000;        // timed operations per scenario
+    int cycles = 3;          // save/load rounds in saveload, background checkpoints in checkpoint
+    bool journal = false;    // journal admissions and discharges as in production
+    double weight = 0;       // recommendation load weight, Rs. per patient
+    int cap = 0;             // patients per doctor; 0 for no cap
+    uint32_t seed = 1;
+    string format = "csv";   // csv or json
+    string scenarios = "burst,churn,surge,bills,reports,saveload,checkpoint,mixed";
+    map<string, int> mix = {{"admit", 30}, {"discharge", 30}, {"emergency", 5}, {"bill", 30}, {"report", 5}};
+
+    // Parses key=value arguments; mix is given as op:weight,op:weight
+    bool parse(int argc, char *argv[], string &error)
+    {
+        for (int i = 0; i < argc; i++)
+        {
+            string arg = argv[i];
+            size_t eq = arg.find('=');
+            string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+            if (eq == string::npos || value.empty())
+            {
+                error = "expected key=value, got \"" + arg + "\"";
+                return false;
+            }
+            if (key == "census")
+                census = max(1, safe_stoi(value, census));
+            else if (key == "rooms")
+                rooms = max(0, safe_stoi(value, rooms));
+            else if (key == "doctors")
+                doctors = max(1, safe_stoi(value, doctors));
+            else if (key == "ops")
+                ops = max(1, safe_stoi(value, ops));
+            else if (key == "cycles")
+                cycles = max(1, safe_stoi(value, cycles));
+            else if (key == "journal")
+                journal = value == "1" || value == "on";
+            else if (key == "weight")
+                weight = max(0.0, safe_stod(value, 0));
+            else if (key == "cap")
+                cap = max(0, safe_stoi(value, 0));
+            else if (key == "seed")
+                seed = (uint32_t)safe_stoi(value, 1);
+            else if (key == "format" && (value == "csv" || value == "json"))
+                format = value;
+            else if (key == "scenarios")
+                scenarios = value;
+            else if (key == "mix")
+            {
+                mix.clear();
+                stringstream entries(value);
+                string entry;
+                while (getline(entries, entry, ','))
+                {
+                    size_t colon = entry.find(':');
+                    string op = entry.substr(0, colon);
+                    if (colon == string::npos || !(op == "admit" || op == "discharge" || op == "emergency" || op == "bill" || op == "report"))
+                    {
+                        error = "bad mix entry \"" + entry + "\" (ops: admit, discharge, emergency, bill, report)";
+                        return false;
+                    }
+                    mix[op] = max(0, safe_stoi(entry.substr(colon + 1), 0));
+                }
+            }
+            else
+            {
+                error = "unknown option \"" + arg + "\"";
+                return false;
+            }
+        }
+        if (rooms == 0)
+            rooms = census + max(1, census / 10);
+        if (rooms < census)
+        {
+            error = "rooms must be at least census";
+            return false;
+        }
+        return true;
+    }
+};
+
+// Swallows cout while alive, for Hospital calls that print progress messages
+class QuietOutput
+{
+private:
+    ostringstream sink;
+    streambuf *saved;
 
-        cout << "Enter severity (Mild/Moderate/Severe): ";
-        cin >> severity;
+public:
+    QuietOutput() : saved(cout.rdbuf(sink.rdbuf())) {}
+    ~QuietOutput() { cout.rdbuf(saved); }
+};
 
-        if (severity != "Mild" && severity != "Moderate" && severity != "Severe")
-        {
-            cout << "Invalid severity! Using 'Moderate' as default.\n";
-            severity = "Moderate";
-        }
+class WorkloadRunner
+{
+private:
+    using Clock = chrono::steady_clock;
 
-        string recommended = recommendLeastCostDoctor(disease, severity);
-        cout << "\nRecommended doctor (least cost): " << recommended << "\n";
-        assignedDoctor = recommended;
+    WorkloadOptions opt;
+    HospitalConfig config;
+    mt19937 rng;
+    unique_ptr<Hospital> hospital;
+    vector<PatientId> live; // admitted patient IDs, in no particular order
+    vector<pair<string, string>> cases; // (disease, severity) admissions draw from
+    uint64_t admitted = 0;
+    map<string, LatencyRecorder> ops; // for the running scenario
+    bool firstRow = true;
 
-        int roomIndex = findAvailableRoom();
-        if (roomIndex == -1)
-        {
-            cout << " Sorry, no rooms are currently available for this emergency patient.\n";
-            return;
-        }
+    template <typename F>
+    void timed(const string &op, F f)
+    {
+        auto start = Clock::now();
+        f();
+        ops[op].add((uint64_t)chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+    }
 
-        for (auto doc : doctors)
-        {
-            if (doc->getName() == assignedDoctor)
-            {
-                doc->setPatientCount(doc->getPatientCount() + 1);
-                break;
-            }
-        }
+    void freshHospital()
+    {
+        remove(config.snapshotFile.c_str());
+        remove(config.dataFile.c_str());
+        remove(config.journalFile.c_str());
+        QuietOutput quiet;
+        hospital.reset(new Hospital(config));
+        live.clear();
+    }
 
-        EmergencyPatient *ep = new EmergencyPatient(name, disease, assignedDoctor, severity, roomIndex + 1);
-        rooms[roomIndex] = true;
-        patients.push_back(ep);
-        cout << "Emergency patient added! Assigned Doctor: " << assignedDoctor << ", Room: " << ep->getRoomNumber() << "\n";
+    bool admitOne(bool emergency, const char *op)
+    {
+        const pair<string, string> &c = cases[rng() % cases.size()];
+        string name = "Patient " + to_string(++admitted);
+        Admission a;
+        timed(op, [&]()
+              { a = hospital->admitPatient(name, c.first, c.second, "", emergency); });
+        if (a.status != AdmitStatus::Admitted)
+            return false;
+        live.push_back(a.id);
+        return true;
     }
 
-    void showAllPatients()
+    void dischargeOne()
     {
-        if (patients.empty())
-        {
-            cout << "No patients in the system.\n";
-            return;
-        }
+        size_t i = rng() % live.size();
+        PatientId id = live[i];
+        live[i] = live.back();
+        live.pop_back();
+        timed("discharge", [&]()
+              { hospital->dischargeById(id); });
+    }
 
-        cout << "Patients List:\n";
-        for (size_t i = 0; i < patients.size(); i++)
-        {
-            cout << i + 1 << ". ";
-            patients[i]->display();
-        }
+    // Brings the census to its steady-state size without timing anything
+    void fill()
+    {
+        while ((int)live.size() < opt.census && admitOne(false, "fill"))
+            ;
+        while ((int)live.size() > opt.census)
+            dischargeOne();
+        ops.clear();
     }
 
-    void showAllEmergencyPatients()
+    void emit(const string &scenario)
     {
-        bool found = false;
-        cout << "Emergency Patients List:\n";
-        for (size_t i = 0; i < patients.size(); i++)
+        for (auto &entry : ops)
         {
-            if (dynamic_cast<EmergencyPatient *>(patients[i]))
+            LatencyRecorder &r = entry.second;
+            double seconds = r.seconds();
+            double throughput = seconds > 0 ? r.count() / seconds : 0;
+            if (opt.format == "json")
             {
-                cout << i + 1 << ". ";
-                patients[i]->display();
-                found = true;
+                cout << "{\"scenario\":\"" << scenario << "\",\"op\":\"" << entry.first << "\",\"count\":" << r.count()
+                     << ",\"seconds\":" << seconds << ",\"ops_per_sec\":" << throughput << ",\"p50_ns\":" << r.percentile(0.50)
+                     << ",\"p99_ns\":" << r.percentile(0.99) << ",\"p999_ns\":" << r.percentile(0.999)
+                     << ",\"max_ns\":" << r.percentile(1.0) << "}\n";
+            }
+            else
+            {
+                cout << scenario << "," << entry.first << "," << r.count() << "," << seconds << "," << throughput << ","
+                     << r.percentile(0.50) << "," << r.percentile(0.99) << "," << r.percentile(0.999) << "," << r.percentile(1.0) << "\n";
             }
         }
-
-        if (!found)
-            cout << "No emergency patients in the system.\n";
+        ops.clear();
     }
 
-    void showAllDoctors()
+    // Admission burst into an empty hospital
+    void burst()
     {
-        cout << "Doctors List:\n";
-        for (auto d : doctors)
-            d->display();
+        freshHospital();
+        while ((int)live.size() < opt.census && admitOne(false, "admit"))
+            ;
     }
 
-    void generateBill()
+    // Steady state: every discharge is followed by an admission
+    void churn()
     {
-        if (patients.empty())
-        {
-            cout << "No patients in system.\n";
-            return;
-        }
-        cout << "Select patient number for bill:\n";
-        showAllPatients();
-        int choice;
-        cin >> choice;
-        if (choice < 1 || choice > (int)patients.size())
+        fill();
+        for (int i = 0; i < opt.ops / 2; i++)
         {
-            cout << "Invalid choice!\n";
-            return;
+            dischargeOne();
+            admitOne(false, "admit");
         }
+    }
 
-        Patient *p = patients[choice - 1];
-        double surcharge = getDoctorSurcharge(p->getAssignedDoctor());
-        double cost = p->calculateBill(diseaseCost, severityMultiplier, surcharge);
-
-        cout << "\n===== BILL =====\n";
-        cout << "Patient Name: " << p->getName() << "\n";
-        cout << "Disease: " << p->getDisease() << "\n";
-        cout << "Severity: " << p->getSeverity() << "\n";
-        cout << "Assigned Doctor: " << p->getAssignedDoctor() << "\n";
-        cout << "Room Number: " << p->getRoomNumber() << "\n";
-        cout << "Total Cost: ₹" << cost << "\n";
-        cout << "================\n";
+    // Emergency admissions fill the headroom above the census, then leave again
+    void surge()
+    {
+        fill();
+        int surgeSize = min(opt.ops, opt.rooms - opt.census);
+        for (int i = 0; i < surgeSize && admitOne(true, "admit-emergency"); i++)
+            ;
+        while ((int)live.size() > opt.census)
+            dischargeOne();
     }
 
-    void generateEmergencyBill()
+    // Single bills for random patients, then whole-census bulk billing
+    void bills()
     {
-        vector<int> emergencyIndices;
-        for (size_t i = 0; i < patients.size(); i++)
+        fill();
+        Bill bill;
+        for (int i = 0; i < opt.ops; i++)
         {
-            if (dynamic_cast<EmergencyPatient *>(patients[i]))
-            {
-                emergencyIndices.push_back(i);
-            }
+            PatientId id = live[rng() % live.size()];
+            timed("bill", [&]()
+                  { hospital->billFor(id, bill); });
         }
+        int passes = max(1, min(100, opt.ops / opt.census));
+        for (int i = 0; i < passes; i++)
+            timed("bill-all", [&]()
+                  { hospital->billAll(); });
+    }
 
-        if (emergencyIndices.empty())
-        {
-            cout << "No emergency patients in system.\n";
-            return;
-        }
+    void reports()
+    {
+        fill();
+        for (int i = 0; i < opt.ops; i++)
+            timed("report", [&]()
+                  { hospital->summarize(); });
+    }
 
-        cout << "Select emergency patient number for bill:\n";
-        for (size_t i = 0; i < emergencyIndices.size(); i++)
+    // Snapshot the census, then start a new Hospital from it
+    void saveload()
+    {
+        fill();
+        for (int i = 0; i < opt.cycles; i++)
         {
-            cout << i + 1 << ". ";
-            patients[emergencyIndices[i]]->display();
+            timed("save", [&]()
+                  { hospital->save(); });
+            hospital.reset();
+            timed("load", [&]()
+                  {
+                      QuietOutput quiet;
+                      hospital.reset(new Hospital(config)); });
         }
+    }
 
-        int choice;
-        cin >> choice;
-        if (choice < 1 || choice > (int)emergencyIndices.size())
+    // Churn while background checkpoints of the census are written; the desks should only
+    // wait for the captures
+    void checkpoint()
+    {
+        fill();
+        int every = max(1, opt.ops / 2 / max(1, opt.cycles));
+        for (int i = 0; i < opt.ops / 2; i++)
         {
-            cout << "Invalid choice!\n";
-            return;
+            if (i % every == 0)
+                timed("checkpoint", [&]()
+                      { hospital->requestCheckpoint(); });
+            dischargeOne();
+            admitOne(false, "admit");
         }
-
-        Patient *ep = patients[emergencyIndices[choice - 1]];
-        double surcharge = getDoctorSurcharge(ep->getAssignedDoctor());
-        double cost = ep->calculateBill(diseaseCost, severityMultiplier, surcharge);
-
-        cout << "\n===== EMERGENCY BILL =====\n";
-        cout << "Patient Name: " << ep->getName() << "\n";
-        cout << "Disease: " << ep->getDisease() << "\n";
-        cout << "Severity: " << ep->getSeverity() << "\n";
-        cout << "Assigned Doctor: " << ep->getAssignedDoctor() << "\n";
-        cout << "Room Number: " << ep->getRoomNumber() << "\n";
-        cout << "Total Emergency Cost: Rs." << cost << "\n";
-        cout << "==========================\n";
     }
 
-    void dischargePatient()
+    // Weighted random operations from opt.mix around the steady-state census
+    void mixed()
     {
-        if (patients.empty())
-        {
-            cout << "No patients to discharge.\n";
-            return;
-        }
-        cout << "Select patient number to discharge:\n";
-        showAllPatients();
-        int choice;
-        cin >> choice;
-        if (choice < 1 || choice > (int)patients.size())
-        {
-            cout << "Invalid choice!\n";
+        fill();
+        vector<pair<string, int>> weights(opt.mix.begin(), opt.mix.end());
+        int total = 0;
+        for (auto &w : weights)
+            total += w.second;
+        if (total == 0)
             return;
-        }
 
-        Patient *p = patients[choice - 1];
-        string docName = p->getAssignedDoctor();
-        for (auto doc : doctors)
+        Bill bill;
+        for (int i = 0; i < opt.ops; i++)
         {
-            if (doc->getName() == docName)
+            int pick = (int)(rng() % total);
+            size_t k = 0;
+            while (pick >= weights[k].second)
+                pick -= weights[k++].second;
+            const string &op = weights[k].first;
+
+            bool full = (int)live.size() >= opt.rooms;
+            if ((op == "admit" || op == "emergency") && !full)
+                admitOne(op == "emergency", op == "emergency" ? "admit-emergency" : "admit");
+            else if (op == "bill" && !live.empty())
             {
-                doc->setPatientCount(doc->getPatientCount() - 1);
-                break;
+                PatientId id = live[rng() % live.size()];
+                timed("bill", [&]()
+                      { hospital->billFor(id, bill); });
             }
+            else if (op == "report")
+                timed("report", [&]()
+                      { hospital->summarize(); });
+            else if (!live.empty())
+                dischargeOne(); // also stands in for admissions when every room is taken
         }
+    }
+
+public:
+    explicit WorkloadRunner(const WorkloadOptions &o) : opt(o), rng(o.seed)
+    {
+        config.snapshotFile = "bench_workload.bin";
+        config.dataFile = "bench_workload.txt";
+        config.journalFile = "bench_workload.log";
+        config.journaling = opt.journal;
+        config.roomCount = opt.rooms;
+        config.loadWeight = opt.weight;
+        config.doctorCap = opt.cap;
 
-        int roomIndex = p->getRoomNumber() - 1;
-        if (roomIndex >= 0 && roomIndex < (int)rooms.size())
+        // Synthetic doctors treat the built-in diseases in rotation
+        if (opt.doctors != 10)
         {
-            rooms[roomIndex] = false;
+            size_t diseaseCount = size(BUILTIN_DISEASE_COSTS);
+            for (int i = 0; i < opt.doctors; i++)
+            {
+                string first(BUILTIN_DISEASE_COSTS[i % diseaseCount].name), second(BUILTIN_DISEASE_COSTS[(i + 5) % diseaseCount].name);
+                config.roster.push_back({"Dr. Synthetic " + to_string(i + 1), {first, second}, 500.0 + 100 * (i % 21)});
+            }
         }
-
-        cout << "Patient " << p->getName() << " discharged and room " << p->getRoomNumber() << " is now free.\n";
-        delete p;
-        patients.erase(patients.begin() + choice - 1);
+        for (auto &d : BUILTIN_DISEASE_COSTS)
+            for (auto &s : BUILTIN_SEVERITY_MULTIPLIERS)
+                cases.push_back({string(d.name), string(s.name)});
     }
 
-    void dischargeEmergencyPatient()
+    int run()
     {
-        vector<int> emergencyIndices;
-        for (size_t i = 0; i < patients.size(); i++)
+        if (opt.format == "json")
+            cout << "{\"config\":{\"census\":" << opt.census << ",\"rooms\":" << opt.rooms << ",\"doctors\":" << opt.doctors
+                 << ",\"ops\":" << opt.ops << ",\"journal\":" << (opt.journal ? "true" : "false") << ",\"weight\":" << opt.weight
+                 << ",\"cap\":" << opt.cap << ",\"seed\":" << opt.seed << "}}\n";
+        else
+            cout << "# census=" << opt.census << " rooms=" << opt.rooms << " doctors=" << opt.doctors << " ops=" << opt.ops
+                 << " journal=" << opt.journal << " weight=" << opt.weight << " cap=" << opt.cap << " seed=" << opt.seed << "\n"
+                 << "scenario,op,count,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n";
+
+        freshHospital();
+        stringstream names(opt.scenarios);
+        string scenario;
+        while (getline(names, scenario, ','))
         {
-            if (dynamic_cast<EmergencyPatient *>(patients[i]))
+            if (scenario == "burst")
+                burst();
+            else if (scenario == "churn")
+                churn();
+            else if (scenario == "surge")
+                surge();
+            else if (scenario == "bills")
+                bills();
+            else if (scenario == "reports")
+                reports();
+            else if (scenario == "saveload")
+                saveload();
+            else if (scenario == "checkpoint")
+                checkpoint();
+            else if (scenario == "mixed")
+                mixed();
+            else
             {
-                emergencyIndices.push_back(i);
+                cerr << "unknown scenario \"" << scenario << "\"\n";
+                return 2;
             }
+            emit(scenario);
         }
 
-        if (emergencyIndices.empty())
-        {
-            cout << "No emergency patients to discharge.\n";
-            return;
-        }
+        hospital.reset();
+        remove(config.snapshotFile.c_str());
+        remove(config.dataFile.c_str());
+        remove(config.journalFile.c_str());
+        return 0;
+    }
+};
 
-        cout << "Select emergency patient number to discharge:\n";
-        for (size_t i = 0; i < emergencyIndices.size(); i++)
-        {
-            cout << i + 1 << ". ";
-            patients[emergencyIndices[i]]->display();
-        }
+int benchmarkWorkload(int argc, char *argv[])
+{
+    WorkloadOptions options;
+    string error;
+    if (!options.parse(argc, argv, error))
+    {
+        cerr << "--bench-workload: " << error << "\n";
+        return 2;
+    }
+    return WorkloadRunner(options).run();
+}
 
-        int choice;
-        cin >> choice;
-        if (choice < 1 || choice > (int)emergencyIndices.size())
-        {
-            cout << "Invalid choice!\n";
-            return;
-        }
+// Concurrency self-check (--stress-desks): N admission desks admit, bill and discharge their
+// own patients in parallel while an auditor thread reports, bills, lists, queries and
+// checkpoints the whole census.
+// Checks that no room is ever handed to two patients, that bills never lose a patient, and
+// that the doctor counts, report totals, room bitmap and journal agree with the census at the
+// end. Returns 0 when every invariant holds.
+int stressDesks(int desks, int opsPerDesk)
+{
+    HospitalConfig config;
+    config.snapshotFile = "stress_desks.bin";
+    config.dataFile = "stress_desks.txt";
+    config.journalFile = "stress_desks.log";
+    config.roomCount = 64 * desks; // small enough that desks regularly find the hospital full
+    // Four wards of unequal size, so placement overflows between wards as well as filling up
+    config.wards = {{"Casualty", 1, RoomType::General, 8 * desks, true, {}},
+                    {"Ward A", 1, RoomType::General, 24 * desks, false, {"Dr. Smith", "Dr. Jones", "Dr. Brown"}},
+                    {"Ward B", 2, RoomType::Isolation, 16 * desks, false, {"Dr. Taylor", "Dr. Wilson"}},
+                    {"ICU", 2, RoomType::ICU, 16 * desks, true, {"Dr. Clark"}}};
+    config.loadWeight = 100;
+    config.doctorCap = 8 * desks; // and that popular doctors regularly reach the cap
+    auto cleanup = [&config]()
+    {
+        remove(config.snapshotFile.c_str());
+        remove(config.dataFile.c_str());
+        remove(config.journalFile.c_str());
+    };
+    cleanup();
 
-        int actualIndex = emergencyIndices[choice - 1];
-        Patient *ep = patients[actualIndex];
-        string docName = ep->getAssignedDoctor();
-        for (auto doc : doctors)
+    unique_ptr<Hospital> h;
+    {
+        QuietOutput quiet;
+        h.reset(new Hospital(config));
+    }
+
+    vector<pair<string, string>> cases;
+    for (auto &d : BUILTIN_DISEASE_COSTS)
+        for (auto &s : BUILTIN_SEVERITY_MULTIPLIERS)
+            cases.push_back({string(d.name), string(s.name)});
+
+    vector<atomic<PatientId>> roomOwner(config.roomCount + 1); // by 1-based room number
+    for (auto &owner : roomOwner)
+        owner = 0;
+    atomic<int> problems(0);
+    atomic<bool> desksDone(false);
+    mutex errLock;
+    auto fail = [&](const string &what)
+    {
+        lock_guard<mutex> guard(errLock);
+        if (problems.fetch_add(1) < 20)
+            cerr << "stress: " << what << "\n";
+    };
+
+    vector<vector<pair<PatientId, int>>> admitted(desks); // per desk: (patient, room)
+    auto desk = [&](int index)
+    {
+        mt19937 rng(index + 1);
+        vector<pair<PatientId, int>> &mine = admitted[index];
+        Bill bill;
+        for (int op = 0; op < opsPerDesk; op++)
         {
-            if (doc->getName() == docName)
+            unsigned pick = rng() % 100;
+            if (pick < 45 || mine.empty())
             {
-                doc->setPatientCount(doc->getPatientCount() - 1);
-                break;
+                const pair<string, string> &c = cases[rng() % cases.size()];
+                Admission a = h->admitPatient("Desk " + to_string(index) + " patient " + to_string(op), c.first, c.second, "", pick % 10 == 0);
+                if (a.status != AdmitStatus::Admitted)
+                    continue;
+                PatientId previous = roomOwner[a.roomNumber].exchange(a.id);
+                if (previous != 0)
+                    fail("room " + to_string(a.roomNumber) + " given to " + to_string(a.id) + " while " + to_string(previous) + " holds it");
+                mine.push_back({a.id, a.roomNumber});
+            }
+            else if (pick < 85)
+            {
+                size_t i = rng() % mine.size();
+                pair<PatientId, int> patient = mine[i];
+                mine[i] = mine.back();
+                mine.pop_back();
+                roomOwner[patient.second] = 0; // before the room can be handed out again
+                if (!h->dischargeById(patient.first))
+                    fail("discharge lost patient " + to_string(patient.first));
+            }
+            else
+            {
+                PatientId id = mine[rng() % mine.size()].first;
+                if (!h->billFor(id, bill))
+                    fail("bill lost patient " + to_string(id));
             }
         }
+    };
 
-        int roomIndex = ep->getRoomNumber() - 1;
-        if (roomIndex >= 0 && roomIndex < (int)rooms.size())
+    auto auditor = [&]()
+    {
+        for (int round = 0; !desksDone; round++)
         {
-            rooms[roomIndex] = false;
+            // Background checkpoints capture and compact the journal under the desks' feet
+            if (round % 8 == 0)
+                h->requestCheckpoint();
+            Summary summary = h->summarize();
+            if (summary.patients < 0 || summary.patients > config.roomCount)
+                fail("report counted " + to_string(summary.patients) + " patients in " + to_string(config.roomCount) + " rooms");
+            h->billAll(1);
+
+            // A snapshot must agree with itself: its listing matches its report, IDs ascend
+            // and no room is held twice
+            shared_ptr<const CensusSnapshot> snap = h->snapshot();
+            size_t listed = 0, emergencies = 0;
+            PatientId last = 0;
+            vector<bool> roomSeen(config.roomCount, false);
+            snap->forEach([&](const CensusSnapshot::Entry &p)
+                          {
+                listed++;
+                emergencies += p.isEmergency();
+                if (p.getId() <= last)
+                    fail("snapshot listed patient " + to_string(p.getId()) + " after " + to_string(last));
+                last = p.getId();
+                int room = p.getRoomNumber() - 1;
+                if (room < 0 || room >= config.roomCount || roomSeen[room])
+                    fail("snapshot has room " + to_string(p.getRoomNumber()) + " twice or out of range");
+                else
+                    roomSeen[room] = true; });
+            const Summary &report = snap->report();
+            if (listed != (size_t)report.patients || emergencies != (size_t)report.emergencies)
+                fail("snapshot listed " + to_string(listed) + " patients but reported " + to_string(report.patients));
+            int byDoctor = 0;
+            for (auto &d : report.doctors)
+            {
+                byDoctor += d.patients;
+                if (d.patients > config.doctorCap)
+                    fail(d.name + " has " + to_string(d.patients) + " patients, over the cap of " + to_string(config.doctorCap));
+            }
+            if (byDoctor != report.patients)
+                fail("snapshot doctors hold " + to_string(byDoctor) + " of " + to_string(report.patients) + " patients");
+
+            // Queries page through live data, so only each page's own matches can be checked
+            PatientQuery query;
+            query.disease = cases[listed % cases.size()].first;
+            query.namePrefix = "Desk " + to_string(listed % desks);
+            query.firstRoom = 1;
+            query.lastRoom = config.roomCount / 2;
+            PatientId after = 0;
+            do
+            {
+                PatientPage page = h->queryPatients(query, after, 16);
+                for (const PatientInfo &p : page.patients)
+                {
+                    if (p.id <= after || p.disease != query.disease || p.name.compare(0, query.namePrefix.size(), query.namePrefix) != 0 ||
+                        p.roomNumber < query.firstRoom || p.roomNumber > query.lastRoom)
+                        fail("query for " + query.disease + " returned patient " + to_string(p.id) + " in room " + to_string(p.roomNumber));
+                    after = p.id;
+                }
+                after = page.cursor;
+            } while (after != 0);
         }
+    };
 
-        cout << "Emergency Patient " << ep->getName() << " discharged and room " << ep->getRoomNumber() << " is now free.\n";
-        delete ep;
-        patients.erase(patients.begin() + actualIndex);
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int i = 0; i < desks; i++)
+        threads.emplace_back(desk, i);
+    thread audit(auditor);
+    for (auto &t : threads)
+        t.join();
+    desksDone = true;
+    audit.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Every desk's surviving patients, and nobody else, must still be admitted
+    size_t expected = 0;
+    for (auto &mine : admitted)
+    {
+        expected += mine.size();
+        for (auto &patient : mine)
+            if (!h->hasPatient(patient.first))
+                fail("patient " + to_string(patient.first) + " vanished");
     }
+    if (h->patientCount() != expected)
+        fail("census holds " + to_string(h->patientCount()) + " patients, desks admitted " + to_string(expected));
+    if (h->roomsAvailable() != config.roomCount - (int)expected)
+        fail(to_string(h->roomsAvailable()) + " rooms free with " + to_string(expected) + " of " + to_string(config.roomCount) + " taken");
+    if (!h->verifyAggregates(cerr))
+        fail("running totals disagree with the census");
 
-    void saveToFile()
+    // Once quiet, the indexes must find every patient, whichever one drives the query
+    PatientQuery everyone, byRoom;
+    byRoom.firstRoom = 1;
+    byRoom.lastRoom = config.roomCount;
+    for (const PatientQuery &q : {everyone, byRoom})
+        if (h->queryPatients(q, 0, expected + 1).patients.size() != expected)
+            fail("query missed patients of the " + to_string(expected) + " admitted");
+
+    // The journal must replay to the same census
+    Summary before = h->summarize();
+    h.reset();
     {
-        ofstream out(dataFile);
-        if (!out)
-        {
-            cout << "Error saving file.\n";
-            return;
-        }
+        QuietOutput quiet;
+        h.reset(new Hospital(config));
+    }
+    Summary after = h->summarize();
+    if (after.patients != before.patients || after.emergencies != before.emergencies)
+        fail("journal replay restored " + to_string(after.patients) + " patients, expected " + to_string(before.patients));
+    for (size_t i = 0; i < before.doctors.size() && i < after.doctors.size(); i++)
+        if (before.doctors[i].patients != after.doctors[i].patients)
+            fail("journal replay gave " + before.doctors[i].name + " " + to_string(after.doctors[i].patients) + " patients");
+    if (!h->verifyAggregates(cerr))
+        fail("replayed totals disagree with the census");
+    h.reset();
+    cleanup();
 
-        // Save doctors
-        out << "DOCTORS " << doctors.size() << "\n";
-        for (auto d : doctors)
-            d->save(out);
+    long long ops = (long long)desks * opsPerDesk;
+    cout << "desks=" << desks << " ops=" << ops << " seconds=" << seconds << " ops_per_sec=" << ops / seconds
+         << " patients=" << expected << " problems=" << problems << "\n";
+    cout << (problems == 0 ? "ok" : "FAILED") << "\n";
+    return problems == 0 ? 0 : 1;
+}
 
-        // Save patients
-        out << "PATIENTS " << patients.size() << "\n";
-        for (auto p : patients)
-            p->save(out);
+#ifdef HOSPITAL_COUNT_ALLOCATIONS
+// Counts heap allocations for --bench-load; only compiled into instrumented builds (glibc)
+#include <malloc.h>
 
-        // Save rooms
-        out << "ROOMS " << rooms.size() << "\n";
-        for (bool room : rooms)
-            out << (room ? "1" : "0") << "\n";
+static size_t allocationCount = 0;
 
-        out.close();
-        cout << "Data saved successfully.\n";
-    }
+// Bytes currently allocated from the heap, including large mmap'd blocks
+size_t heapBytesInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
 
-    void loadFromFile()
+void *operator new(size_t size)
+{
+    allocationCount++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+// The default operator delete already releases with free()
+#endif
+
+// Resident set size of the process in bytes, from /proc/self/statm; 0 where that is missing
+size_t residentBytes()
+{
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Startup cost of a large census: writes a synthetic text save with `count` patients, imports
+// it, then times a fresh Hospital loading the resulting binary snapshot. Each phase reports
+// the growth in resident memory per patient; allocation counts and heap bytes per patient
+// are reported too when built with -DHOSPITAL_COUNT_ALLOCATIONS.
+int benchmarkLoad(int count)
+{
+    using Clock = chrono::steady_clock;
+    HospitalConfig config;
+    config.dataFile = "bench_load.txt";
+    config.snapshotFile = "bench_load.bin";
+    config.journaling = false;
+    remove(config.snapshotFile.c_str());
+
+    const char *diseases[][2] = {{"Flu", "Dr. Smith"}, {"Cold", "Dr. Wilson"}, {"Diabetes", "Dr. Jones"}, {"Asthma", "Dr. Brown"}, {"Heart Disease", "Dr. Clark"}};
+    const char *severities[] = {"Mild", "Moderate", "Severe"};
     {
-        ifstream in(dataFile);
-        if (!in)
+        ofstream out(config.dataFile);
+        out << "PATIENTS " << count << "\n";
+        for (int i = 0; i < count; i++)
         {
-            cout << "No previous data found. Starting fresh.\n";
-            return;
+            out << (i % 10 == 0 ? "EMERGENCY " : "PATIENT ") << i + 1 << "\n";
+            out << "Patient " << i + 1 << "\n";
+            out << diseases[i % 5][0] << "\n";
+            out << diseases[i % 5][1] << "\n";
+            out << severities[i % 3] << "\n";
+            out << i + 1 << "\n";
         }
+        out << "ROOMS " << count << "\n";
+        for (int i = 0; i < count; i++)
+            out << "1\n";
+    }
 
-        // Clear existing patients but keep fresh doctors
-        for (auto p : patients)
-            delete p;
-        patients.clear();
+    cout << "phase,patients,ms,rss_mb,rss_bytes_per_patient,allocations,heap_bytes_per_patient\n";
+    size_t resident = 0;
+#ifdef HOSPITAL_COUNT_ALLOCATIONS
+    size_t allocations = 0, heapBytes = 0;
+#endif
+    auto mark = [&]()
+    {
+        resident = residentBytes();
+#ifdef HOSPITAL_COUNT_ALLOCATIONS
+        allocations = allocationCount;
+        heapBytes = heapBytesInUse();
+#endif
+    };
+    auto report = [&](const char *phase, Clock::time_point start, size_t patients)
+    {
+        double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        size_t now = residentBytes();
+        cout << phase << "," << patients << "," << ms << "," << now / 1048576.0 << ","
+             << ((double)now - (double)resident) / max<size_t>(patients, 1) << ",";
+#ifdef HOSPITAL_COUNT_ALLOCATIONS
+        cout << allocationCount - allocations << "," << ((double)heapBytesInUse() - (double)heapBytes) / max<size_t>(patients, 1);
+#else
+        cout << "n/a,n/a";
+#endif
+        cout << "\n";
+    };
 
-        string line;
-        while (getline(in, line))
+    // Both loads run quietly so their status lines stay out of the CSV
+    unique_ptr<Hospital> text, binary;
+    mark();
+    auto start = Clock::now();
+    {
+        QuietOutput quiet;
+        text.reset(new Hospital(config)); // no snapshot yet, so this reads the text save
+    }
+    report("text_load", start, text->patientCount());
+    bool saved = text->save();
+
+    mark();
+    start = Clock::now();
+    {
+        QuietOutput quiet;
+        binary.reset(new Hospital(config));
+    }
+    report("snapshot_load", start, binary->patientCount());
+
+    remove(config.dataFile.c_str());
+    remove(config.snapshotFile.c_str());
+    return saved && binary->patientCount() == (size_t)count ? 0 : 1;
+}
+
+// Roster startup at 100, 10k and 100k doctors. Each size is written to a synthetic roster
+// file and timed by phase: "parse" reads the file, "incremental" registers and indexes the
+// doctors one insert at a time as the roster used to be built, "registry" and "index" are
+// the registry and disease index built in one pass each, "recommender" builds the heaps, and
+// "startup" is a whole Hospital coming up on the file with no saved census.
+int benchmarkRoster()
+{
+    using Clock = chrono::steady_clock;
+    const char *rosterFile = "bench_roster.txt";
+    size_t diseaseCount = size(BUILTIN_DISEASE_COSTS);
+    auto disease = [&](size_t i)
+    { return string(BUILTIN_DISEASE_COSTS[i % diseaseCount].name); };
+    auto ms = [](Clock::time_point start)
+    { return chrono::duration<double, milli>(Clock::now() - start).count(); };
+
+    cout << "phase,doctors,ms\n";
+    bool ok = true;
+    for (int count : {100, 10000, 100000})
+    {
         {
-            if (line.find("DOCTORS") == 0)
+            ofstream out(rosterFile);
+            out << "# name | surcharge | specialties\n";
+            for (int i = 0; i < count; i++)
             {
-                // Skip doctors section - we use fresh doctors
-                int numDoctors = safe_stoi(line.substr(8), 0);
-                for (int i = 0; i < numDoctors; i++)
-                {
-                    string marker;
-                    getline(in, marker); // Skip doctor data
-                    if (marker != "DOCTOR")
-                        break;
-                    for (int j = 0; j < 4; j++)
-                        getline(in, marker); // Skip doctor details
-                    int numSpec = safe_stoi(marker, 0);
-                    for (int j = 0; j < numSpec; j++)
-                        getline(in, marker); // Skip specialties
-                }
+                out << "Dr. Roster " << i + 1 << " | " << 500 + 100 * (i % 21) << " | " << disease(i) << " | " << disease(i + 5);
+                if (i % 3 == 0)
+                    out << " | " << disease(i + 9);
+                out << "\n";
             }
-            else if (line.find("PATIENTS") == 0)
-            {
-                int numPatients = safe_stoi(line.substr(9), 0);
-                for (int i = 0; i < numPatients; i++)
-                {
-                    string type;
-                    if (!getline(in, type))
-                        break;
-
-                    Patient *p;
-                    if (type == "EMERGENCY")
-                    {
-                        p = new EmergencyPatient();
-                    }
-                    else if (type == "PATIENT")
-                    {
-                        p = new Patient();
-                    }
-                    else
-                    {
-                        // Skip invalid data
-                        for (int j = 0; j < 5; j++)
-                            getline(in, type);
-                        continue;
-                    }
-                    p->load(in);
-                    patients.push_back(p);
+        }
 
-                    // Update room status and doctor patient count
-                    int roomIndex = p->getRoomNumber() - 1;
-                    if (roomIndex >= 0 && roomIndex < (int)rooms.size())
-                    {
-                        rooms[roomIndex] = true;
-                    }
+        vector<DoctorSpec> roster;
+        string error;
+        auto start = Clock::now();
+        if (!loadRoster(rosterFile, roster, error))
+        {
+            cerr << error << "\n";
+            return 1;
+        }
+        cout << "parse," << count << "," << ms(start) << "\n";
 
-                    string docName = p->getAssignedDoctor();
-                    for (auto doc : doctors)
-                    {
-                        if (doc->getName() == docName)
-                        {
-                            doc->setPatientCount(doc->getPatientCount() + 1);
-                            break;
-                        }
-                    }
-                }
-            }
-            else if (line.find("ROOMS") == 0)
+        {
+            DoctorRegistry registry;
+            DiseaseIndex index;
+            start = Clock::now();
+            for (auto &d : roster)
             {
-                int numRooms = safe_stoi(line.substr(6), TOTAL_ROOMS);
-                rooms.resize(numRooms, false);
-                for (int i = 0; i < numRooms; ++i)
-                {
-                    string occupied;
-                    if (!getline(in, occupied))
-                        break;
-                    rooms[i] = (occupied == "1");
-                }
+                int id = registry.add(d.name, d.specialties, d.surcharge);
+                index.addDoctor(id, *registry.get(id));
             }
+            cout << "incremental," << count << "," << ms(start) << "\n";
         }
 
-        in.close();
-        cout << "Data loaded successfully.\n";
-    }
+        DoctorRegistry registry;
+        DiseaseIndex index;
+        start = Clock::now();
+        registry.assign(move(roster));
+        cout << "registry," << count << "," << ms(start) << "\n";
+        start = Clock::now();
+        index.build(registry);
+        cout << "index," << count << "," << ms(start) << "\n";
 
-    void summaryReport()
-    {
-        cout << "\n===== HOSPITAL SUMMARY REPORT =====\n";
-        map<string, int> docPatientCount;
-        map<string, double> docRevenue;
-        double totalRevenue = 0;
+        TariffSchedule tariffs;
+        DoctorRecommender recommender;
+        start = Clock::now();
+        recommender.rebuild(index, registry, tariffs);
+        cout << "recommender," << count << "," << ms(start) << "\n";
 
-        for (auto doc : doctors)
+        HospitalConfig config;
+        config.rosterFile = rosterFile;
+        config.snapshotFile = "bench_roster.bin";
+        config.dataFile = "bench_roster.dat";
+        config.journaling = false;
+        remove(config.snapshotFile.c_str());
+        remove(config.dataFile.c_str());
+        double elapsed;
         {
-            docPatientCount[doc->getName()] = 0;
-            docRevenue[doc->getName()] = 0;
+            QuietOutput quiet;
+            start = Clock::now();
+            Hospital h(config);
+            elapsed = ms(start);
+            ok = ok && h.doctorCount() == count;
         }
+        cout << "startup," << count << "," << elapsed << "\n";
+    }
+    remove(rosterFile);
+    return ok ? 0 : 1;
+}
 
-        for (auto p : patients)
-        {
-            double surcharge = getDoctorSurcharge(p->getAssignedDoctor());
-            double cost = p->calculateBill(diseaseCost, severityMultiplier, surcharge);
-            docPatientCount[p->getAssignedDoctor()]++;
-            docRevenue[p->getAssignedDoctor()] += cost;
-            totalRevenue += cost;
-        }
+int main(int argc, char *argv[])
+{
+    // Leading options shared by the batch and interactive modes
+    HospitalConfig config;
+    while (argc > 2)
+    {
+        string option = argv[1];
+        if (option == "--tariffs")
+            config.tariffFile = argv[2];
+        else if (option == "--load-weight")
+            config.loadWeight = max(0.0, safe_stod(argv[2], 0));
+        else if (option == "--doctor-cap")
+            config.doctorCap = max(0, safe_stoi(argv[2], 0));
+        else if (option == "--autosave")
+            config.autosaveSeconds = max(0, safe_stoi(argv[2], 0));
+        else if (option == "--roster")
+            config.rosterFile = argv[2];
+        else if (option == "--wards")
+            config.wardFile = argv[2];
+        else
+            break;
+        argv += 2;
+        argc -= 2;
+    }
 
-        for (auto doc : doctors)
+    if (argc > 1 && string(argv[1]) == "--bench-rooms")
+        return benchmarkRooms();
+    if (argc > 1 && string(argv[1]) == "--bench-wards")
+        return benchmarkWards();
+    if (argc > 1 && string(argv[1]) == "--bench-billing")
+        return benchmarkBilling();
+    if (argc > 1 && string(argv[1]) == "--bench-tariff")
+        return benchmarkTariff();
+    if (argc > 1 && string(argv[1]) == "--stress-desks")
+        return stressDesks(argc > 2 ? max(1, safe_stoi(argv[2], 8)) : 8, argc > 3 ? max(1, safe_stoi(argv[3], 20000)) : 20000);
+    if (argc > 1 && string(argv[1]) == "--bench-workload")
+        return benchmarkWorkload(argc - 2, argv + 2);
+    if (argc > 1 && string(argv[1]) == "--bench-roster")
+        return benchmarkRoster();
+    if (argc > 1 && string(argv[1]) == "--bench-load")
+        return benchmarkLoad(argc > 2 ? max(1, safe_stoi(argv[2], 1000000)) : 1000000);
+    if (argc > 1 && string(argv[1]) == "--batch")
+    {
+        ios::sync_with_stdio(false);
+        Hospital h(config);
+        if (argc > 2 && string(argv[2]) != "-")
         {
-            cout << "Doctor: " << doc->getName() << ", Patients Treated: " << docPatientCount[doc->getName()]
-                 << ", Revenue: Rs." << docRevenue[doc->getName()] << "\n";
+            ifstream in(argv[2]);
+            if (!in)
+            {
+                cerr << "Cannot open batch file " << argv[2] << "\n";
+                return 1;
+            }
+            return runBatch(h, in, cout);
         }
-
-        cout << "Total Hospital Revenue: ₹" << totalRevenue << "\n";
-        cout << "===================================\n";
+        return runBatch(h, cin, cout);
     }
-};
 
-int main()
-{
-    Hospital h;
+    Hospital h(config);
     int choice;
     do
     {
@@ -938,6 +8100,15 @@ int main()
         cout << "9. Show Emergency Patients\n";
         cout << "10. Generate Emergency Bill\n";
         cout << "11. Discharge Emergency Patient\n";
+        cout << "12. Export To Text File\n";
+        cout << "13. Import From Text File\n";
+#ifndef HOSPITAL_NO_METRICS
+        cout << "14. Show Metrics\n";
+#endif
+        cout << "15. Find Patients\n";
+        cout << "16. Checkpoint In Background\n";
+        cout << "17. Reload Tariffs\n";
+        cout << "18. Show Wards\n";
         cout << "0. Exit\n";
         cout << "Enter choice: ";
 
@@ -984,6 +8155,30 @@ int main()
         case 11:
             h.dischargeEmergencyPatient();
             break;
+        case 12:
+            h.exportToText();
+            break;
+        case 13:
+            h.importFromText();
+            break;
+#ifndef HOSPITAL_NO_METRICS
+        case 14:
+            h.showMetrics();
+            break;
+#endif
+        case 15:
+            findPatients(h);
+            break;
+        case 16:
+            h.requestCheckpoint();
+            cout << "Checkpoint queued; saving in the background.\n";
+            break;
+        case 17:
+            reloadTariffFile(h);
+            break;
+        case 18:
+            h.showWards();
+            break;
         case 0:
             cout << "Exiting...\n";
             break;